@@ -1,14 +1,34 @@
+#define _GNU_SOURCE
 #include <X11/Xlib.h>
 #include <X11/Xft/Xft.h>
 #include <X11/Xutil.h>
 #include <X11/X.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/sync.h>
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 
 #define DRW_IMPLEMENTATION
 #include "drw.h"
+#include "record.h"
 
 /*
  * Copyright (C) 2024  Gabriel de Brito
@@ -32,48 +52,344 @@
  */
 
 #define LENGTH(X) (sizeof X / sizeof X[0])
-
+/* Outer size of the frame around a w x h client. */
+#define FRAME_W(w) ((w) + TITLE_WIDTH + BORDER_WIDTH * 4)
+#define FRAME_H(h) ((h) + BORDER_WIDTH * 2)
+/* Wraps calls that wait for a reply from the server, to count them. */
+#define ROUNDTRIP(wm, call) ((wm)->stats.round_trips++, (call))
+/* Spans for the trace file. When not tracing they're just a branch. */
+#define TRACE_BEGIN(wm) ((wm)->trace != NULL ? now_ns() : 0)
+#define TRACE_END(wm, name, start) \
+	do { \
+		if ((wm)->trace != NULL && (start) != 0) \
+			trace_span((wm), (name), (start)); \
+	} while (0)
+#define MAX_TIMERS 8
+#define MAX_IDLE 8
+#define EVENT_BATCH 64
+#define STATUS_LEN 256
+#define MAX_CONTROL 8
+#define CONTROL_LEN 1024
+/* Histogram sub-buckets per power of two (so ~12% precision). */
+#define HIST_SUB 8
+#define HIST_BUCKETS (40 * HIST_SUB)
+#define CLIENT_CHUNK 256
+/* Render jobs the event thread can be ahead of the renderer. */
+#define RENDER_QUEUE 64
+#define MAX_WORKSPACES 9
+/* Candidate positions smart_place looks at, at most. */
+#define MAX_PLACE 256
+
+typedef struct Wm Wm;
+typedef struct Workspace Workspace;
+
+/* The list a client is in. Fullscreen is on top of floating or tiled, see
+ * Workspace.fullscreen. */
+enum { LayerNone, LayerFloating, LayerTiled, LayerHidden };
+
+/* Fields looked at while walking the lists come first. */
 typedef struct Client {
-	char *name;
 	Window id;
 	Window title;
-	GC title_gc;
+	/* Parent of the client and the title. */
+	Window frame;
+	struct Client *next;
+	struct Client *prev;
+	int layer;
+	/* Where its floating or tiled list is. Hidden clients are shown on the
+	 * workspace they're unhidden on. */
+	Workspace *ws;
+	/* Geometry as last configured, the outer corner and inner size of the
+	 * client. */
+	int x;
+	int y;
+	int w;
+	int h;
 	int req_w;
 	int req_h;
 	int req_x;
 	int req_y;
-	struct Client *next;
-	struct Client *prev;
+	char *name;
+	/* The title is painted as focused. */
+	short int title_focus;
+	/* Buttons are grabbed, see set_grab. */
+	short int grabbed;
+	/* WM_NAME changed and wasn't fetched yet, see flush_properties. */
+	short int name_dirty;
 } Client;
 
+/* Clients live in chunks that are never freed, so they keep their address and
+ * managing windows doesn't touch malloc once the pool is warm. */
+typedef struct ClientChunk {
+	Client clients[CLIENT_CHUNK];
+	struct ClientChunk *next;
+} ClientChunk;
+
+/* Slot of the window table, which maps the client, title and frame windows
+ * of every client to it (see find_window). */
+typedef struct {
+	/* None if free. */
+	Window win;
+	Client *c;
+} WindowSlot;
+
+/* The layer of a client is in c->layer. */
+typedef struct {
+	Client *c;
+	short int is_title;
+	short int is_frame;
+} FindResult;
+
+/* Each workspace has its own floating and tiled clients, only the hidden are
+ * shared. */
+struct Workspace {
+	Client *floating;
+	Client *tiled;
+	Client *current;
+	Client *fullscreen;
+	int n_tiled;
+	/* Width of its label in the left bar. */
+	unsigned int w;
+};
+
+/* A frame edge: where it is, and what it spans on the other axis. */
+typedef struct {
+	int v;
+	int lo;
+	int hi;
+	/* To the opposite edge, positive on left and top edges. 0 on the
+	 * screen's. */
+	int size;
+} Edge;
+
+/* Frame edges of the floating clients on screen and the edges of the screen,
+ * each axis sorted by coordinate, so the ones near a point are a binary search
+ * away. Built by build_index when a drag starts, or a placement finds it
+ * stale. */
+typedef struct {
+	Edge *x;
+	Edge *y;
+	int n;
+	int cap;
+	/* Widest frame, so a left edge further than that from a point is
+	 * known not to reach it. */
+	int max_w;
+	/* Still matches the floating frames on screen, as set_layer adds the
+	 * clients becoming floating. Cleared by anything else moving them. */
+	int fresh;
+	/* Distinct coordinates smart_place tries, cap of each. */
+	int *rows;
+	int *cols;
+} Index;
+
 typedef struct Cursors {
 	Cursor left_ptr;
 	Cursor fleur;
 	Cursor sizing;
 } Cursors;
 
+/* Docks are drawn by the renderer, see render. */
 typedef struct {
 	Window win;
+	/* Last job queued for it, and last one shown. */
+	unsigned long seq;
+	unsigned long applied;
+	/* Latest job not handed to the renderer yet (see submit_renders),
+	 * NULL if none. */
+	struct RenderJob *pending;
+} Dock;
+
+/* Single-producer single-consumer ring of pointers, lock-free: head is only
+ * written by the consumer and tail by the producer. */
+typedef struct {
+	void *slots[RENDER_QUEUE];
+	unsigned int head;
+	unsigned int tail;
+} Ring;
+
+/* A piece of text for the renderer. */
+typedef struct {
+	/* In jobs without a size cells go left to right, as wide as their text
+	 * and as high as the job, and the renderer fills these in. */
+	int x;
+	int y;
+	unsigned int w;
+	unsigned int h;
+	/* Drawn with color_f. */
+	short int focus;
+	char text[STATUS_LEN];
+} RenderCell;
+
+/* What a dock should look like. The renderer draws it to pixmap and hands the
+ * job back, see apply_renders. */
+typedef struct RenderJob {
+	Dock *dock;
+	unsigned long seq;
+	/* Monotonic nanoseconds the renderer spent on it, for the trace. */
+	long long drawn_start;
+	long long drawn_end;
+	/* 0 to fit the cells. */
+	unsigned int w;
+	unsigned int h;
+	Pixmap pixmap;
+	int n;
+	RenderCell cells[];
+} RenderJob;
+
+/* Everything Xft and fontconfig is done in the renderer thread, on its own
+ * connection, so a slow font match never holds up events. */
+typedef struct {
+	Display *dpy;
 	Drw *drw;
+	/* Loaded once for all docks. */
+	Fnt *font;
 	Clr *color;
 	Clr *color_f;
-	Fnt *font;
-} Dock;
+	pthread_t thread;
+	/* Jobs to draw, and the same jobs back once drawn. */
+	Ring jobs;
+	Ring done;
+	/* eventfds: there are jobs, there are drawn jobs, there's room in
+	 * done. */
+	int jobs_fd;
+	int done_fd;
+	int space_fd;
+} Renderer;
+
+enum {
+	WMProtocols,
+	NetSupported,
+	NetWMSyncRequest,
+	NetWMSyncRequestCounter,
+	NetWMState,
+	NetWMStateFullscreen,
+	NetWMBypassCompositor,
+	NetSupportingWMCheck,
+	NetWMName,
+	UTF8String,
+	AtomLast
+};
+
+/* An interactive resize, paced to what the client can draw (see
+ * flush_resize). */
+typedef struct {
+	/* NULL when not resizing. */
+	Client *c;
+	/* Latest size the pointer asks for. */
+	int w;
+	int h;
+	/* Monotonic milliseconds of the last configure. */
+	long long at;
+	/* A sync request wasn't answered yet. */
+	int waiting;
+	/* None if the client doesn't do _NET_WM_SYNC_REQUEST. */
+	XSyncAlarm alarm;
+	XSyncCounter counter;
+	long long value;
+} Resize;
+
+/* Phases of setup, timed from XOpenDisplay (see startup_phase). */
+enum { PhaseConnect, PhaseDocks, PhaseLoop, PhaseRenderer, PhaseBars, PhaseLast };
+
+/* High-level operations whose X traffic is accounted. */
+enum { OpManage, OpUnmanage, OpFocus, OpHide, OpUnhide, OpDrag, OpStatus, OpWorkspace, OpLast };
 
 typedef struct {
-	Client *floating;
-	Client *tiled;
+	unsigned long long count;
+	unsigned long long requests;
+	unsigned long long round_trips;
+	unsigned long max_requests;
+	unsigned long max_round_trips;
+	/* Times it took more round trips than round_trip_budget allows. */
+	unsigned long long over_budget;
+} OpStats;
+
+/* Log-linear histogram of nanoseconds, like HdrHistogram. */
+typedef struct {
+	unsigned long long count;
+	unsigned long long sum;
+	unsigned long long max;
+	unsigned int buckets[HIST_BUCKETS];
+} Histogram;
+
+typedef struct {
+	/* Time from getting each event type until waiting for the next one,
+	 * nested loops included. */
+	Histogram events[LASTEvent];
+	/* From the server timestamp of input events until they're handled. */
+	Histogram lag;
+	/* Smallest (local clock - server time) seen, the lag baseline. */
+	long long lag_offset;
+	int last_type;
+	Time last_time;
+	long long last_start;
+	unsigned long round_trips;
+	/* Nested operations count as part of the outermost one. */
+	int op_depth;
+	int op;
+	unsigned long op_request;
+	unsigned long op_round_trips;
+	OpStats ops[OpLast];
+	/* Nanoseconds from XOpenDisplay to the end of each phase. */
+	long long phases[PhaseLast];
+} Stats;
+
+/* A connection to the control socket. */
+typedef struct {
+	/* -1 if the slot is free. */
+	int fd;
+	/* Inside begin/commit. */
+	int batch;
+	/* expire_batches committed it, the commit has to fail. */
+	int expired;
+	/* Monotonic milliseconds of the last read, for expire_batches. */
+	long long at;
+	size_t len;
+	char buf[CONTROL_LEN];
+} Control;
+
+typedef struct {
+	void (*fn)(Wm *wm);
+	/* Monotonic milliseconds, 0 if the slot is free. */
+	long long at;
+} Timer;
+
+struct Wm {
+	Workspace workspaces[MAX_WORKSPACES];
+	/* The one on screen. */
+	Workspace *ws;
 	Client *hidden;
-	Client *current;
+	/* Client pool, unused ones are linked by next. */
+	ClientChunk *chunks;
+	Client *free_clients;
+	/* Open addressing, at most half full. cap is a power of two. */
+	WindowSlot *windows;
+	int n_windows;
+	int cap_windows;
+	/* The current one (of any workspace) as of the last restore_focus. */
+	Client *focused;
 	int n_hidden;
-	int n_tiled;
 	Dock menu;
 	Dock right_bar;
 	Dock left_bar;
+	Renderer render;
 	unsigned int hid_w;
 	unsigned int spawn_w;
 	unsigned int bar_h;
-	char *status;
+	char status[STATUS_LEN];
+	char next_status[STATUS_LEN];
+	/* The root's WM_NAME changed, see flush_properties. */
+	int status_dirty;
+	/* Clients whose WM_NAME changed, once each. */
+	Window *dirty;
+	int n_dirty;
+	int cap_dirty;
+	/* Monotonic milliseconds of the last flush_properties. */
+	long long props_at;
+	/* Partial line read from the status FIFO. */
+	char fifo_buf[STATUS_LEN];
+	size_t fifo_len;
+	long long status_at;
 	Display *dpy;
 	int screen;
 	int sw;
@@ -81,7 +397,61 @@ typedef struct {
 	Window root;
 	Cursors cursors;
 	KeyCode fkey;
-} Wm;
+	int epfd;
+	int tfd;
+	int sfd;
+	int status_fd;
+	int ctl_fd;
+	Control ctl[MAX_CONTROL];
+	/* While > 0 restore_focus only marks relayout, so a batch of commands
+	 * is committed once. */
+	int batch;
+	int relayout;
+	/* Tiled frames have to be lowered below the floating ones again, set
+	 * when clients change layers. Otherwise focus only raises the current
+	 * floating frame. */
+	int restack;
+	/* A fullscreen window covers the bars and titles, so they aren't drawn
+	 * (see uncover). */
+	int covered;
+	Timer timers[MAX_TIMERS];
+	/* Events read but not handled yet, cosmetic ones last (see
+	 * read_batch). */
+	XEvent queue[EVENT_BATCH];
+	int queue_head;
+	int queue_len;
+	/* Cosmetic work waiting for the queue to run dry (see defer). */
+	void (*idle[MAX_IDLE])(Wm *wm);
+	int n_idle;
+	/* Monotonic milliseconds of the last run_idle. */
+	long long idle_at;
+	/* Inside a drag or a menu, where idle work is capped per frame. */
+	int interactive;
+	/* We hold a server grab (OUTLINE_DRAG), see submit_renders. */
+	int server_grabbed;
+	Atom atoms[AtomLast];
+	/* Child of the root toolkits look for to know an EWMH window manager
+	 * is running, see init_ewmh. */
+	Window wm_check;
+	/* Event type of sync alarms, -1 without the extension. */
+	int sync_event;
+	Resize resize;
+	/* The client being moved or resized, NULL if it was unmanaged meanwhile
+	 * (see end_drag). */
+	Client *dragged;
+	Index index;
+	/* With OUTLINE_DRAG, and the client geometry the outline stands for. */
+	GC outline_gc;
+	XRectangle outline;
+	Stats stats;
+	/* Monotonic nanoseconds when XOpenDisplay was called. */
+	long long started;
+	/* Trace event file, NULL when not tracing. */
+	FILE *trace;
+	/* Event log (see record.h), NULL when not recording. */
+	FILE *record;
+	long long record_at;
+};
 
 typedef struct {
 	const char *label;
@@ -90,274 +460,1814 @@ typedef struct {
 	unsigned int w;
 } MenuItem;
 
+typedef struct {
+	/* Writes the component to buf, returns 0 if it's not available. */
+	int (*fn)(char *buf, size_t len, const char *arg, long long *state);
+	const char *arg;
+	/* Private to fn, for things like network rates. */
+	long long state[3];
+} StatusItem;
+
+int status_clock(char *buf, size_t len, const char *arg, long long *state);
+int status_load(char *buf, size_t len, const char *arg, long long *state);
+int status_memory(char *buf, size_t len, const char *arg, long long *state);
+int status_battery(char *buf, size_t len, const char *arg, long long *state);
+int status_network(char *buf, size_t len, const char *arg, long long *state);
+
 #include "config.h"
 
+#if WORKSPACES < 1 || WORKSPACES > MAX_WORKSPACES
+#error "WORKSPACES must be between 1 and 9"
+#endif
+
+static char *atom_names[AtomLast] = {
+	[WMProtocols] = "WM_PROTOCOLS",
+	[NetSupported] = "_NET_SUPPORTED",
+	[NetWMSyncRequest] = "_NET_WM_SYNC_REQUEST",
+	[NetWMSyncRequestCounter] = "_NET_WM_SYNC_REQUEST_COUNTER",
+	[NetWMState] = "_NET_WM_STATE",
+	[NetWMStateFullscreen] = "_NET_WM_STATE_FULLSCREEN",
+	[NetWMBypassCompositor] = "_NET_WM_BYPASS_COMPOSITOR",
+	[NetSupportingWMCheck] = "_NET_SUPPORTING_WM_CHECK",
+	[NetWMName] = "_NET_WM_NAME",
+	[UTF8String] = "UTF8_STRING",
+};
+
+/* The error handler doesn't get the Wm. Indexed by error code. */
+static unsigned long long x_errors[256];
+
 void handle_event(Wm *i, XEvent *ev);
+void index_client(Wm *wm, Client *c);
+FindResult find_window(Wm *wm, Window win);
+void read_status_fifo(Wm *wm);
+void control_event(Wm *wm, int fd);
+void apply_renders(Wm *wm);
+void unframe(Wm *wm, Client *c);
+void flush_resize(Wm *wm);
+void view_workspace(Wm *wm, Workspace *ws);
 
 int error_handler(Display *dpy, XErrorEvent *e)
 {
+	x_errors[e->error_code]++;
 	return 0;
 }
 
-typedef struct {
+long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Writes a complete span in the trace event format (chrome://tracing,
+ * Perfetto). The closing ] is optional in the format, so the file is valid
+ * even if we die while tracing. */
+void trace_emit(Wm *wm, const char *name, int tid, long long start, long long end)
+{
+	fprintf(wm->trace,
+		"{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld.%03lld,\"dur\":%lld.%03lld},\n",
+		name,
+		tid,
+		start / 1000,
+		start % 1000,
+		(end - start) / 1000,
+		(end - start) % 1000);
+}
+
+/* A span of the event thread (tid 1), ending now. The renderer's are tid 2,
+ * see apply_renders. */
+void trace_span(Wm *wm, const char *name, long long start)
+{
+	trace_emit(wm, name, 1, start, now_ns());
+}
+
+void trace_stop(Wm *wm)
+{
+	if (wm->trace == NULL)
+		return;
+	fprintf(wm->trace, "{}]\n");
+	fclose(wm->trace);
+	wm->trace = NULL;
+}
+
+int trace_start(Wm *wm, const char *path)
+{
+	trace_stop(wm);
+	if ((wm->trace = fopen(path, "we")) == NULL)
+		return 0;
+	fprintf(wm->trace, "[\n");
+	return 1;
+}
+
+void record_stop(Wm *wm)
+{
+	if (wm->record == NULL)
+		return;
+	fclose(wm->record);
+	wm->record = NULL;
+}
+
+int record_start(Wm *wm, const char *path)
+{
+	record_stop(wm);
+	if ((wm->record = fopen(path, "we")) == NULL)
+		return 0;
+	fwrite(RECORD_MAGIC, 1, strlen(RECORD_MAGIC), wm->record);
+	wm->record_at = now_ns();
+	return 1;
+}
+
+/* Logs the events needed to reproduce a session: clients coming and going,
+ * their requests and names, and input. Querying geometry and names costs
+ * round trips, but only while recording. */
+void record_event(Wm *wm, XEvent *ev)
+{
+	RecordEntry r;
+	XTextProperty prop;
+	FindResult f;
+	Window _dumbw;
+	unsigned int w, h, _dumbu;
+	int x, y, i;
+	long long now = now_ns();
+	char *name = NULL, *atoms[3], text[STATUS_LEN];
+
+	memset(&r, 0, sizeof(r));
+	r.type = ev->type;
+	r.window = ev->xany.window;
+
+	switch (ev->type) {
+	case ButtonPress:
+	case ButtonRelease:
+	case MotionNotify:
+	case KeyPress:
+	case KeyRelease:
+		/* state, time and the root position are at the same place in
+		 * these, the detail isn't. */
+		if (ev->type == ButtonPress || ev->type == ButtonRelease)
+			r.detail = ev->xbutton.button;
+		else if (ev->type == KeyPress || ev->type == KeyRelease)
+			r.detail = ev->xkey.keycode;
+		r.state = ev->xbutton.state;
+		r.time = ev->xbutton.time;
+		r.x = ev->xbutton.x_root;
+		r.y = ev->xbutton.y_root;
+		break;
+	case MapRequest:
+		r.window = ev->xmaprequest.window;
+		if (ROUNDTRIP(wm, XGetGeometry(wm->dpy, r.window, &_dumbw, &x, &y, &w, &h, &_dumbu, &_dumbu))) {
+			r.x = x;
+			r.y = y;
+			r.w = w;
+			r.h = h;
+		}
+		if (ROUNDTRIP(wm, XGetWMName(wm->dpy, r.window, &prop)))
+			name = (char*) prop.value;
+		break;
+	case ConfigureRequest:
+		r.window = ev->xconfigurerequest.window;
+		r.state = ev->xconfigurerequest.value_mask;
+		r.x = ev->xconfigurerequest.x;
+		r.y = ev->xconfigurerequest.y;
+		r.w = ev->xconfigurerequest.width;
+		r.h = ev->xconfigurerequest.height;
+		break;
+	case DestroyNotify:
+		r.window = ev->xdestroywindow.window;
+		break;
+	case UnmapNotify:
+		/* Only clients withdrawing, not frames we hid. The synthetic
+		 * copy ICCCM asks for would be a second entry. */
+		f = find_window(wm, ev->xunmap.window);
+		if (f.c == NULL || f.is_title || f.is_frame || ev->xunmap.send_event)
+			return;
+		r.window = ev->xunmap.window;
+		break;
+	case PropertyNotify:
+		if (ev->xproperty.atom != XA_WM_NAME)
+			return;
+		if (ROUNDTRIP(wm, XGetWMName(wm->dpy, r.window, &prop)))
+			name = (char*) prop.value;
+		break;
+	case ClientMessage:
+		/* Only the ones client_message looks at. Atom ids are the
+		 * server's, so they go by name. */
+		if (ev->xclient.message_type != wm->atoms[NetWMState] || ev->xclient.format != 32)
+			return;
+		for (i = 0; i < 4; i++)
+			r.data[i] = ev->xclient.data.l[i];
+		for (i = 0; i < 3; i++) {
+			atoms[i] = NULL;
+			if (i == 0 || ev->xclient.data.l[i] != None)
+				atoms[i] = ROUNDTRIP(wm, XGetAtomName(wm->dpy, i == 0 ? ev->xclient.message_type : ev->xclient.data.l[i]));
+		}
+		snprintf(text, sizeof(text), "%s %s %s",
+			atoms[0] != NULL ? atoms[0] : "",
+			atoms[1] != NULL ? atoms[1] : "-",
+			atoms[2] != NULL ? atoms[2] : "-");
+		for (i = 0; i < 3; i++) {
+			if (atoms[i] != NULL)
+				XFree(atoms[i]);
+		}
+		name = text;
+		break;
+	default:
+		return;
+	}
+
+	/* The root is 0, its id is meaningless on another server. */
+	if (r.window == wm->root)
+		r.window = 0;
+	if (name != NULL)
+		r.len = strnlen(name, STATUS_LEN);
+	r.dt = (now - wm->record_at) / 1000;
+	wm->record_at = now;
+	fwrite(&r, sizeof(r), 1, wm->record);
+	if (name != NULL) {
+		fwrite(name, 1, r.len, wm->record);
+		if (name != text)
+			XFree(name);
+	}
+}
+
+/* Replies are best-effort, a client that doesn't read them just loses them.
+ * Works for plain files too, for stderr. */
+void reply(int fd, const char *fmt, ...)
+{
+	char buf[CONTROL_LEN];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (n <= 0)
+		return;
+	if (n >= sizeof(buf))
+		n = sizeof(buf) - 1;
+	if (send(fd, buf, n, MSG_DONTWAIT | MSG_NOSIGNAL) < 0 && errno == ENOTSOCK)
+		write(fd, buf, n);
+}
+
+int hist_bucket(unsigned long long v)
+{
+	int e;
+
+	if (v < HIST_SUB)
+		return v;
+	e = 63 - __builtin_clzll(v);
+	v = (e - 2) * HIST_SUB + ((v >> (e - 3)) & (HIST_SUB - 1));
+	return v < HIST_BUCKETS ? v : HIST_BUCKETS - 1;
+}
+
+unsigned long long hist_value(int bucket)
+{
+	int e;
+
+	if (bucket < HIST_SUB)
+		return bucket;
+	e = bucket / HIST_SUB + 2;
+	return (unsigned long long) (HIST_SUB + bucket % HIST_SUB) << (e - 3);
+}
+
+void hist_record(Histogram *h, long long v)
+{
+	if (v < 0)
+		v = 0;
+	h->count++;
+	h->sum += v;
+	if (v > h->max)
+		h->max = v;
+	h->buckets[hist_bucket(v)]++;
+}
+
+/* Lower bound of the bucket holding the q quantile. */
+unsigned long long hist_quantile(Histogram *h, double q)
+{
+	unsigned long long seen = 0, want = q * h->count;
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > want)
+			return hist_value(i);
+	}
+	return h->max;
+}
+
+void dump_hist(int fd, const char *name, Histogram *h)
+{
+	if (h->count == 0)
+		return;
+	reply(fd,
+		"%-18s count %8llu  mean %8lluus  p50 %8lluus  p90 %8lluus  p99 %8lluus  p99.9 %8lluus  max %8lluus\n",
+		name,
+		h->count,
+		h->sum / h->count / 1000,
+		hist_quantile(h, 0.5) / 1000,
+		hist_quantile(h, 0.9) / 1000,
+		hist_quantile(h, 0.99) / 1000,
+		hist_quantile(h, 0.999) / 1000,
+		h->max / 1000);
+}
+
+static const char *event_names[LASTEvent] = {
+	[KeyPress] = "KeyPress",
+	[KeyRelease] = "KeyRelease",
+	[ButtonPress] = "ButtonPress",
+	[ButtonRelease] = "ButtonRelease",
+	[MotionNotify] = "MotionNotify",
+	[EnterNotify] = "EnterNotify",
+	[LeaveNotify] = "LeaveNotify",
+	[FocusIn] = "FocusIn",
+	[FocusOut] = "FocusOut",
+	[KeymapNotify] = "KeymapNotify",
+	[Expose] = "Expose",
+	[GraphicsExpose] = "GraphicsExpose",
+	[NoExpose] = "NoExpose",
+	[VisibilityNotify] = "VisibilityNotify",
+	[CreateNotify] = "CreateNotify",
+	[DestroyNotify] = "DestroyNotify",
+	[UnmapNotify] = "UnmapNotify",
+	[MapNotify] = "MapNotify",
+	[MapRequest] = "MapRequest",
+	[ReparentNotify] = "ReparentNotify",
+	[ConfigureNotify] = "ConfigureNotify",
+	[ConfigureRequest] = "ConfigureRequest",
+	[GravityNotify] = "GravityNotify",
+	[ResizeRequest] = "ResizeRequest",
+	[CirculateNotify] = "CirculateNotify",
+	[CirculateRequest] = "CirculateRequest",
+	[PropertyNotify] = "PropertyNotify",
+	[SelectionClear] = "SelectionClear",
+	[SelectionRequest] = "SelectionRequest",
+	[SelectionNotify] = "SelectionNotify",
+	[ColormapNotify] = "ColormapNotify",
+	[ClientMessage] = "ClientMessage",
+	[MappingNotify] = "MappingNotify",
+	[GenericEvent] = "GenericEvent",
+};
+
+static const char *phase_names[PhaseLast] = {
+	[PhaseConnect] = "connect",
+	[PhaseDocks] = "docks",
+	[PhaseLoop] = "event loop",
+	[PhaseRenderer] = "renderer",
+	[PhaseBars] = "bars drawn",
+};
+
+static const char *op_names[OpLast] = {
+	[OpManage] = "manage",
+	[OpUnmanage] = "unmanage",
+	[OpFocus] = "focus click",
+	[OpHide] = "hide",
+	[OpUnhide] = "unhide",
+	[OpDrag] = "drag frame",
+	[OpStatus] = "status update",
+	[OpWorkspace] = "workspace switch",
+};
+
+void op_begin(Wm *wm, int op)
+{
+	Stats *st = &wm->stats;
+
+	if (st->op_depth++ > 0)
+		return;
+	st->op = op;
+	st->op_request = NextRequest(wm->dpy);
+	st->op_round_trips = st->round_trips;
+}
+
+void op_end(Wm *wm)
+{
+	Stats *st = &wm->stats;
+	OpStats *op;
+	unsigned long requests, round_trips;
+
+	if (--st->op_depth > 0)
+		return;
+	op = &st->ops[st->op];
+	requests = NextRequest(wm->dpy) - st->op_request;
+	round_trips = st->round_trips - st->op_round_trips;
+
+	op->count++;
+	op->requests += requests;
+	op->round_trips += round_trips;
+	if (requests > op->max_requests)
+		op->max_requests = requests;
+	if (round_trips > op->max_round_trips)
+		op->max_round_trips = round_trips;
+	if (round_trip_budget[st->op] > 0 && round_trips > round_trip_budget[st->op])
+		op->over_budget++;
+}
+
+/* Dumped on SIGUSR1 (to stderr) and by the "stats" control command. */
+void dump_stats(Wm *wm, int fd)
+{
+	OpStats *op;
+	int i;
+
+	reply(fd, "handler time per event type:\n");
+	for (i = 0; i < LASTEvent; i++)
+		dump_hist(fd, event_names[i] != NULL ? event_names[i] : "Other", &wm->stats.events[i]);
+	reply(fd, "input lag (server timestamp to handled):\n");
+	dump_hist(fd, "input", &wm->stats.lag);
+
+	reply(fd, "startup (from XOpenDisplay):\n");
+	for (i = 0; i < PhaseLast; i++)
+		reply(fd, "%-18s %8lluus\n", phase_names[i], wm->stats.phases[i] / 1000);
+
+	reply(fd, "X traffic per operation:\n");
+	for (i = 0; i < OpLast; i++) {
+		op = &wm->stats.ops[i];
+		if (op->count == 0)
+			continue;
+		reply(fd,
+			"%-18s count %8llu  requests %6.1f (max %4lu)  round trips %5.1f (max %3lu, budget %2d, over %llu)\n",
+			op_names[i],
+			op->count,
+			(double) op->requests / op->count,
+			op->max_requests,
+			(double) op->round_trips / op->count,
+			op->max_round_trips,
+			round_trip_budget[i],
+			op->over_budget);
+	}
+
+	reply(fd, "X errors:\n");
+	for (i = 0; i < LENGTH(x_errors); i++) {
+		if (x_errors[i] > 0)
+			reply(fd, "%-18d count %8llu\n", i, x_errors[i]);
+	}
+}
+
+/* Marks the end of a phase of setup. setup waits for the left bar to be
+ * drawn, so PhaseBars is when there's something on the screen. */
+void startup_phase(Wm *wm, int phase)
+{
+	wm->stats.phases[phase] = now_ns() - wm->started;
+}
+
+/* Called as soon as we're done with the last event, so the time since it
+ * was received is how long it took to handle it. */
+void stats_handled(Wm *wm)
+{
+	Stats *st = &wm->stats;
+	long long now, lag;
+
+	if (st->last_type == 0)
+		return;
+	now = now_ns();
+	hist_record(&st->events[st->last_type], now - st->last_start);
+	TRACE_END(wm, event_names[st->last_type] != NULL ? event_names[st->last_type] : "Other", st->last_start);
+
+	if (st->last_time != CurrentTime) {
+		/* Server time is in milliseconds from an unknown origin. When
+		 * it's way off the baseline the server clock wrapped. */
+		lag = now / 1000000 - (long long) st->last_time;
+		if (st->lag_offset == 0 || lag < st->lag_offset || lag - st->lag_offset > 3600000)
+			st->lag_offset = lag;
+		hist_record(&st->lag, (lag - st->lag_offset) * 1000000);
+	}
+	st->last_type = 0;
+}
+
+void stats_received(Wm *wm, XEvent *ev)
+{
+	Stats *st = &wm->stats;
+
+	st->last_type = ev->type < LASTEvent ? ev->type : 0;
+	st->last_start = now_ns();
+	switch (ev->type) {
+	case KeyPress:
+	case KeyRelease:
+	case ButtonPress:
+	case ButtonRelease:
+	case MotionNotify:
+		/* time is at the same place in all of these. */
+		st->last_time = ev->xbutton.time;
+		break;
+	default:
+		st->last_time = CurrentTime;
+	}
+}
+
+/* Arms the timerfd to the earliest pending timer, or disarms it if there's
+ * none, so we never wake up while idle. */
+void arm_timer(Wm *wm)
+{
+	struct itimerspec its;
+	long long at = 0;
+	int i;
+
+	for (i = 0; i < MAX_TIMERS; i++) {
+		if (wm->timers[i].at != 0 && (at == 0 || wm->timers[i].at < at))
+			at = wm->timers[i].at;
+	}
+
+	memset(&its, 0, sizeof(its));
+	if (at != 0) {
+		its.it_value.tv_sec = at / 1000;
+		its.it_value.tv_nsec = (at % 1000) * 1000000;
+	}
+	timerfd_settime(wm->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* Runs fn after ms milliseconds. Scheduling an already pending fn just moves
+ * its deadline. */
+void schedule(Wm *wm, void (*fn)(Wm *wm), long ms)
+{
+	int i, slot = -1;
+
+	for (i = 0; i < MAX_TIMERS; i++) {
+		if (wm->timers[i].at != 0 && wm->timers[i].fn == fn) {
+			slot = i;
+			break;
+		}
+		if (wm->timers[i].at == 0 && slot < 0)
+			slot = i;
+	}
+	assert(slot >= 0 && "Raise MAX_TIMERS");
+
+	wm->timers[slot].fn = fn;
+	wm->timers[slot].at = now_ms() + (ms > 0 ? ms : 0);
+	arm_timer(wm);
+}
+
+int scheduled(Wm *wm, void (*fn)(Wm *wm))
+{
+	int i;
+
+	for (i = 0; i < MAX_TIMERS; i++) {
+		if (wm->timers[i].at != 0 && wm->timers[i].fn == fn)
+			return 1;
+	}
+	return 0;
+}
+
+void run_timers(Wm *wm)
+{
+	uint64_t expirations;
+	long long now = now_ms();
+	void (*fn)(Wm *wm);
+	int i;
+
+	read(wm->tfd, &expirations, sizeof(expirations));
+
+	for (i = 0; i < MAX_TIMERS; i++) {
+		if (wm->timers[i].at != 0 && wm->timers[i].at <= now) {
+			fn = wm->timers[i].fn;
+			wm->timers[i].at = 0;
+			fn(wm);
+		}
+	}
+	arm_timer(wm);
+}
+
+/* Runs fn once nothing is waiting to be handled. Deferring an already
+ * pending fn does nothing, so it runs once however many times it was
+ * asked for. */
+void defer(Wm *wm, void (*fn)(Wm *wm))
+{
+	int i;
+
+	for (i = 0; i < wm->n_idle; i++) {
+		if (wm->idle[i] == fn)
+			return;
+	}
+	assert(wm->n_idle < MAX_IDLE && "Raise MAX_IDLE");
+	wm->idle[wm->n_idle++] = fn;
+}
+
+/* During a drag or a menu the queue runs dry between every motion, so
+ * there idle work only runs once per FRAME_INTERVAL. Whatever is deferred
+ * while running goes to the next round. */
+void run_idle(Wm *wm)
+{
+	void (*idle[MAX_IDLE])(Wm *wm);
+	long long since = now_ms() - wm->idle_at;
+	int i, n = wm->n_idle;
+
+	if (n == 0)
+		return;
+	if (wm->interactive && since < FRAME_INTERVAL) {
+		schedule(wm, run_idle, FRAME_INTERVAL - since);
+		return;
+	}
+	memcpy(idle, wm->idle, n * sizeof(idle[0]));
+	wm->n_idle = 0;
+	wm->idle_at = now_ms();
+	for (i = 0; i < n; i++)
+		idle[i](wm);
+}
+
+void quit(Wm *wm)
+{
 	Client *c;
-	short int is_float;
-	short int is_hidden;
-	short int is_tiled;
-	short int is_title;
-} FindResult;
+	Workspace *ws;
+
+	for (ws = wm->workspaces; ws < wm->workspaces + WORKSPACES; ws++) {
+		for (c = ws->floating; c != NULL; c = c->next)
+			unframe(wm, c);
+		for (c = ws->tiled; c != NULL; c = c->next)
+			unframe(wm, c);
+	}
+	for (c = wm->hidden; c != NULL; c = c->next)
+		unframe(wm, c);
+	XDeleteProperty(wm->dpy, wm->root, wm->atoms[NetSupportingWMCheck]);
+	XDestroyWindow(wm->dpy, wm->wm_check);
+	trace_stop(wm);
+	record_stop(wm);
+	XCloseDisplay(wm->dpy);
+	exit(0);
+}
+
+void handle_signal(Wm *wm)
+{
+	struct signalfd_siginfo si;
+
+	while (read(wm->sfd, &si, sizeof(si)) == sizeof(si)) {
+		switch (si.ssi_signo) {
+		case SIGCHLD:
+			while (waitpid(-1, NULL, WNOHANG) > 0);
+			break;
+		case SIGHUP:
+		case SIGTERM:
+			quit(wm);
+			break;
+		case SIGUSR1:
+			dump_stats(wm, 2);
+			break;
+		}
+	}
+}
+
+/* Names changing, which only mark redraws and nothing waits on. Nothing
+ * draws on Expose, the server paints titles from their backgrounds. */
+int is_cosmetic(XEvent *ev)
+{
+	return ev->type == PropertyNotify;
+}
+
+/* Takes up to EVENT_BATCH of the n pending events, so input and structural
+ * events are handled before the cosmetic ones that arrived with them. Each
+ * kind keeps its order. */
+void read_batch(Wm *wm, int n)
+{
+	XEvent later[EVENT_BATCH];
+	int i, n_later = 0;
+
+	wm->queue_head = 0;
+	wm->queue_len = 0;
+	for (i = 0; i < n && i < EVENT_BATCH; i++) {
+		XNextEvent(wm->dpy, &wm->queue[wm->queue_len]);
+		if (wm->record != NULL)
+			record_event(wm, &wm->queue[wm->queue_len]);
+		if (is_cosmetic(&wm->queue[wm->queue_len]))
+			later[n_later++] = wm->queue[wm->queue_len];
+		else
+			wm->queue_len++;
+	}
+	memcpy(&wm->queue[wm->queue_len], later, n_later * sizeof(XEvent));
+	wm->queue_len += n_later;
+}
+
+/* Blocks until there's an X event, running timers, idle work and handling
+ * signals while waiting. Every event loop (including the nested ones) must
+ * get events through here. */
+void next_event(Wm *wm, XEvent *ev)
+{
+	struct epoll_event events[4];
+	int i, n, pending;
+
+	stats_handled(wm);
+
+	while (wm->queue_len == 0) {
+		/* XPending flushes the output buffer too. */
+		pending = XPending(wm->dpy);
+		if (!pending && wm->n_idle > 0) {
+			run_idle(wm);
+			pending = XPending(wm->dpy);
+		}
+		n = epoll_wait(wm->epfd, events, LENGTH(events), pending ? 0 : -1);
+		for (i = 0; i < n; i++) {
+			if (events[i].data.fd == wm->tfd)
+				run_timers(wm);
+			else if (events[i].data.fd == wm->sfd)
+				handle_signal(wm);
+			else if (events[i].data.fd == wm->status_fd)
+				read_status_fifo(wm);
+			else if (events[i].data.fd == wm->render.done_fd)
+				apply_renders(wm);
+			else
+				control_event(wm, events[i].data.fd);
+		}
+		if (pending)
+			read_batch(wm, pending);
+	}
+
+	*ev = wm->queue[wm->queue_head++];
+	wm->queue_len--;
+	stats_received(wm, ev);
+}
+
+void spawn(Wm *wm, const char **command)
+{
+	sigset_t mask;
+
+	if (fork() == 0) {
+		close(ConnectionNumber(wm->dpy));
+		close(ConnectionNumber(wm->render.dpy));
+		sigemptyset(&mask);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+		setsid();
+		execvp(command[0], (char * const *) command);
+		exit(1);
+	}
+}
+
+/* Slot win is looked for from. Ids are mostly sequential, so they're mixed. */
+int window_home(Wm *wm, Window win)
+{
+	return (int) ((win * 2654435761UL) >> 8) & (wm->cap_windows - 1);
+}
+
+/* Where win is in the window table, or the free slot it would go to. */
+int window_slot(Wm *wm, Window win)
+{
+	int mask = wm->cap_windows - 1;
+	int i = window_home(wm, win);
+
+	while (wm->windows[i].win != None && wm->windows[i].win != win)
+		i = (i + 1) & mask;
+	return i;
+}
+
+void add_window(Wm *wm, Window win, Client *c)
+{
+	WindowSlot *old = wm->windows;
+	int i, cap = wm->cap_windows;
+
+	if ((wm->n_windows + 1) * 2 > wm->cap_windows) {
+		wm->cap_windows = cap ? cap * 2 : 64;
+		wm->windows = calloc(wm->cap_windows, sizeof(WindowSlot));
+		assert(wm->windows != NULL && "Buy more ram lol");
+		for (i = 0; i < cap; i++) {
+			if (old[i].win != None)
+				wm->windows[window_slot(wm, old[i].win)] = old[i];
+		}
+		free(old);
+	}
+	i = window_slot(wm, win);
+	if (wm->windows[i].win == None)
+		wm->n_windows++;
+	wm->windows[i] = (WindowSlot) { win, c };
+}
+
+/* Moves back the windows after the freed slot that would no longer be
+ * found past it. */
+void remove_window(Wm *wm, Window win)
+{
+	int mask = wm->cap_windows - 1;
+	int i, j, home;
 
+	if (wm->cap_windows == 0 || wm->windows[i = window_slot(wm, win)].win == None)
+		return;
+	wm->n_windows--;
+	for (j = (i + 1) & mask; wm->windows[j].win != None; j = (j + 1) & mask) {
+		home = window_home(wm, wm->windows[j].win);
+		/* Stays if its home is cyclically within i+1..j. */
+		if (i <= j ? (home > i && home <= j) : (home > i || home <= j))
+			continue;
+		wm->windows[i] = wm->windows[j];
+		i = j;
+	}
+	wm->windows[i].win = None;
+}
+
+/* Any of the windows of a client, in constant time. */
 FindResult find_window(Wm *wm, Window win)
 {
-	Client *c;
 	FindResult r;
+	int i;
+
 	r.c = NULL;
-	r.is_float = 0;
-	r.is_hidden = 0;
-	r.is_tiled = 0;
-	r.is_title = 0;
-
-	for (c = wm->floating; c != NULL; c = c->next) {
-		if (c->id == win || (r.is_title = (c->title == win))) {
-			r.is_float = 1;
-			r.c = c;
-			return r;
+	if (wm->cap_windows > 0 && wm->windows[i = window_slot(wm, win)].win != None)
+		r.c = wm->windows[i].c;
+	r.is_title = r.c != NULL && r.c->title == win;
+	r.is_frame = r.c != NULL && r.c->frame == win;
+	return r;
+}
+
+Client **layer_list(Wm *wm, Workspace *ws, int layer)
+{
+	switch (layer) {
+	case LayerFloating:
+		return &ws->floating;
+	case LayerTiled:
+		return &ws->tiled;
+	case LayerHidden:
+		return &wm->hidden;
+	}
+	return NULL;
+}
+
+/* Moves c to the front of layer in c->ws (LayerNone just takes it out).
+ * Every layer change goes through here, keeping the lists, their counts and
+ * the current and fullscreen windows of the workspace consistent. */
+void set_layer(Wm *wm, Client *c, int layer)
+{
+	Workspace *ws = c->ws;
+	Client **list;
+	Client *next = c->next, *prev = c->prev;
+
+	if (layer == LayerFloating && c->layer != LayerFloating && ws == wm->ws && ws->fullscreen != c)
+		index_client(wm, c);
+	else if (layer == LayerFloating || c->layer == LayerFloating)
+		wm->index.fresh = 0;
+
+	if ((list = layer_list(wm, ws, c->layer)) != NULL) {
+		if (prev != NULL)
+			prev->next = next;
+		if (next != NULL)
+			next->prev = prev;
+		if (*list == c)
+			*list = next;
+		if (c->layer == LayerTiled)
+			ws->n_tiled--;
+		if (c->layer == LayerHidden)
+			wm->n_hidden--;
+	}
+
+	/* Leaving the screen. */
+	if (layer == LayerNone || layer == LayerHidden) {
+		if (ws->fullscreen == c)
+			ws->fullscreen = NULL;
+		if (ws->current == c && c->layer != LayerHidden) {
+			if (next != NULL)
+				ws->current = next;
+			else if (prev != NULL)
+				ws->current = prev;
+			else if (ws->tiled != NULL)
+				ws->current = ws->tiled;
+			else
+				ws->current = ws->floating;
 		}
 	}
-	for (c = wm->tiled; c != NULL; c = c->next) {
-		if (c->id == win || (r.is_title = (c->title == win))) {
-			r.is_tiled = 1;
-			r.c = c;
-			return r;
+
+	c->layer = layer;
+	c->prev = NULL;
+	c->next = NULL;
+	wm->restack = 1;
+	if ((list = layer_list(wm, ws, layer)) == NULL)
+		return;
+	c->next = *list;
+	if (*list != NULL)
+		(*list)->prev = c;
+	*list = c;
+	if (layer == LayerTiled)
+		ws->n_tiled++;
+	if (layer == LayerHidden)
+		wm->n_hidden++;
+}
+
+/* Returns 0 if the ring is full. */
+int ring_push(Ring *r, void *p)
+{
+	unsigned int tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+	if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RENDER_QUEUE)
+		return 0;
+	r->slots[tail % RENDER_QUEUE] = p;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/* Returns NULL if the ring is empty. */
+void *ring_pop(Ring *r)
+{
+	unsigned int head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	void *p;
+
+	if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	p = r->slots[head % RENDER_QUEUE];
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return p;
+}
+
+void notify(int fd)
+{
+	uint64_t one = 1;
+
+	write(fd, &one, sizeof(one));
+}
+
+/* Blocks (on the blocking eventfds) until notified. */
+void wait_notify(int fd)
+{
+	uint64_t n;
+
+	read(fd, &n, sizeof(n));
+}
+
+RenderJob *new_job(int n)
+{
+	RenderJob *job = calloc(1, sizeof(RenderJob) + n * sizeof(RenderCell));
+
+	assert(job != NULL && "Buy more ram lol");
+	job->n = n;
+	return job;
+}
+
+/* Runs in the renderer thread. The pixmap is created on the renderer's
+ * connection, and synced so it's complete before the event thread uses it.
+ * That sync waits out server grabs, which is why the event thread never
+ * waits on the renderer (see render). */
+void render_job(Renderer *r, RenderJob *job)
+{
+	RenderCell *cell;
+	unsigned int w, h, x = 0;
+	int i;
+
+	job->drawn_start = now_ns();
+	if (job->w == 0) {
+		for (i = 0; i < job->n; i++) {
+			cell = &job->cells[i];
+			drw_font_getexts(r->font, cell->text, strlen(cell->text), &w, &h);
+			cell->x = x;
+			cell->w = w;
+			x += w;
+			job->h = MAX(job->h, h);
+		}
+		job->w = x;
+		for (i = 0; i < job->n; i++) {
+			job->cells[i].y = 0;
+			job->cells[i].h = job->h;
 		}
 	}
-	for (c = wm->hidden; c != NULL; c = c->next) {
-		if (c->id == win || (r.is_title = (c->title == win))) {
-			r.is_hidden = 1;
-			r.c = c;
-			return r;
+
+	drw_resize(r->drw, MAX(job->w, 1), MAX(job->h, 1));
+	drw_setscheme(r->drw, r->color);
+	drw_rect(r->drw, 0, 0, MAX(job->w, 1), MAX(job->h, 1), 1, 1);
+	for (i = 0; i < job->n; i++) {
+		cell = &job->cells[i];
+		drw_setscheme(r->drw, cell->focus ? r->color_f : r->color);
+		drw_text(r->drw, cell->x, cell->y, cell->w, cell->h, 0, cell->text, 0);
+	}
+	/* It's the event thread's now, drw_resize mustn't free it. */
+	job->pixmap = r->drw->drawable;
+	r->drw->drawable = None;
+	XSync(r->dpy, False);
+	job->drawn_end = now_ns();
+}
+
+/* Of the jobs queued at once only the last of each dock is drawn. */
+void *render_thread(void *arg)
+{
+	Renderer *r = arg;
+	RenderJob *batch[RENDER_QUEUE];
+	int i, j, n;
+
+	for (;;) {
+		wait_notify(r->jobs_fd);
+		n = 0;
+		while (n < RENDER_QUEUE && (batch[n] = ring_pop(&r->jobs)) != NULL)
+			n++;
+
+		for (i = 0; i < n; i++) {
+			for (j = i + 1; j < n && batch[j]->dock != batch[i]->dock; j++);
+			if (j < n) {
+				free(batch[i]);
+				continue;
+			}
+			render_job(r, batch[i]);
+			while (!ring_push(&r->done, batch[i]))
+				wait_notify(r->space_fd);
+			notify(r->done_fd);
 		}
 	}
+	return NULL;
+}
 
-	return r;
+/* Hands the pending jobs to the renderer, unless the server is grabbed (the
+ * renderer couldn't finish them before the ungrab anyway). Those that don't
+ * fit in the ring stay pending until apply_renders makes room. */
+void submit_renders(Wm *wm)
+{
+	Dock *docks[] = { &wm->left_bar, &wm->right_bar, &wm->menu };
+	int i, pushed = 0;
+
+	if (wm->server_grabbed)
+		return;
+	for (i = 0; i < LENGTH(docks); i++) {
+		if (docks[i]->pending != NULL && ring_push(&wm->render.jobs, docks[i]->pending)) {
+			docks[i]->pending = NULL;
+			pushed = 1;
+		}
+	}
+	if (pushed)
+		notify(wm->render.jobs_fd);
+}
+
+/* Queues job for the renderer, replacing the one still pending for the same
+ * dock. Never blocks: there's at most a job pending per dock, however far
+ * behind the renderer is. */
+void render(Wm *wm, Dock *dock, RenderJob *job)
+{
+	job->dock = dock;
+	job->seq = ++dock->seq;
+	free(dock->pending);
+	dock->pending = job;
+	submit_renders(wm);
+}
+
+/* The left bar job has a cell per button, in order. */
+void left_bar_layout(Wm *wm, RenderJob *job)
+{
+	RenderCell *cell = job->cells;
+	Workspace *ws;
+	int i;
+
+	wm->hid_w = (cell++)->w;
+	wm->spawn_w = (cell++)->w;
+	for (ws = wm->workspaces; WORKSPACES > 1 && ws < wm->workspaces + WORKSPACES; ws++)
+		ws->w = (cell++)->w;
+	for (i = 0; i < LENGTH(items); i++)
+		items[i].w = (cell++)->w;
+	wm->bar_h = job->h;
+	XMoveResizeWindow(wm->dpy, wm->left_bar.win, 0, 0, job->w, job->h);
+}
+
+/* Puts what the renderer drew on the docks, as their background so the
+ * server repaints them by itself. Jobs overtaken by a newer one for the same
+ * dock are dropped. The time the renderer took goes in the trace as its own
+ * thread. */
+void apply_renders(Wm *wm)
+{
+	Renderer *r = &wm->render;
+	RenderJob *job;
+	uint64_t n;
+	int got = 0;
+
+	read(r->done_fd, &n, sizeof(n));
+	while ((job = ring_pop(&r->done)) != NULL) {
+		got = 1;
+		if (wm->trace != NULL) {
+			trace_emit(wm,
+				job->dock == &wm->menu ? "draw_menu" : job->dock == &wm->left_bar ? "draw_left_bar" : "draw_right_bar",
+				2,
+				job->drawn_start,
+				job->drawn_end);
+		}
+		if (job->seq == job->dock->seq) {
+			job->dock->applied = job->seq;
+			if (job->dock == &wm->left_bar)
+				left_bar_layout(wm, job);
+			else if (job->dock == &wm->right_bar)
+				XMoveResizeWindow(wm->dpy, wm->right_bar.win, wm->sw - job->w - BORDER_WIDTH * 2, 0, job->w, job->h);
+			XSetWindowBackgroundPixmap(wm->dpy, job->dock->win, job->pixmap);
+			XClearWindow(wm->dpy, job->dock->win);
+		}
+		XFreePixmap(wm->dpy, job->pixmap);
+		free(job);
+	}
+	if (got)
+		notify(r->space_fd);
+	submit_renders(wm);
+}
+
+/* Only for setup, which needs the size of the left bar. */
+void wait_render(Wm *wm, Dock *dock)
+{
+	struct pollfd pfd;
+
+	pfd.fd = wm->render.done_fd;
+	pfd.events = POLLIN;
+	while (dock->applied != dock->seq) {
+		poll(&pfd, 1, -1);
+		apply_renders(wm);
+	}
 }
 
 void render_right_bar(Wm *wm)
 {
-	unsigned int w, h;
-	Dock *bar = &wm->right_bar;
+	RenderJob *job;
+	long long start = TRACE_BEGIN(wm);
 
-	if (wm->status != NULL) {
-		drw_font_getexts(bar->font, wm->status, strlen(wm->status), &w, &h);
-		XMoveResizeWindow(wm->dpy, bar->win, wm->sw - w - BORDER_WIDTH * 2, 0, w, h);
-		drw_resize(bar->drw, w, h);
-		drw_text(bar->drw, 0, 0, w, h, 0, wm->status, 0);
-		drw_map(bar->drw, bar->win, 0, 0, w, h);
+	if (wm->covered)
+		return;
+	if (wm->status[0] != '\0') {
+		job = new_job(1);
+		strcpy(job->cells[0].text, wm->status);
+		render(wm, &wm->right_bar, job);
 	}
+	TRACE_END(wm, "render_right_bar", start);
 }
 
-/* 0 = no opened, 1 = hidden, 2 = spawn. */
-void render_left_bar(Wm *wm, short int opened)
+void draw_status(Wm *wm)
 {
-	unsigned int w, h, totw, toth;
-	Dock *bar = &wm->left_bar;
-	char *hidt = " Hidden ";
-	char *spawnt = " Spawn  ";
-	int i;
+	op_begin(wm, OpStatus);
+	render_right_bar(wm);
+	op_end(wm);
+}
+
+/* Sets the status and, if it changed, redraws the right bar once the
+ * events waiting are handled. */
+void set_status(Wm *wm, const char *status)
+{
+	if (strncmp(wm->status, status, STATUS_LEN - 1) == 0)
+		return;
+	strncpy(wm->status, status, STATUS_LEN - 1);
+	wm->status[STATUS_LEN - 1] = '\0';
+	defer(wm, draw_status);
+	wm->status_at = now_ms();
+}
 
-	if (opened == 1)
-		hidt = "[Hidden]";
-	else if (opened == 2)
-		spawnt = "[Spawn] ";
+void flush_status(Wm *wm)
+{
+	set_status(wm, wm->next_status);
+}
 
-	drw_font_getexts(bar->font, hidt, 8, &w, &h);
-	wm->hid_w = w;
-	toth = h;
-	drw_font_getexts(bar->font, spawnt, 8, &w, &h);
-	wm->spawn_w = w;
-	toth = h > toth ? h : toth;
-	totw = wm->hid_w + wm->spawn_w;
+/* Like set_status, but never redraws the bar more than once per
+ * FRAME_INTERVAL. Only the latest status of a frame is drawn. */
+void queue_status(Wm *wm, const char *status)
+{
+	long long since = now_ms() - wm->status_at;
 
-	for (i = 0; i < LENGTH(items); i++) {
-		drw_font_getexts(bar->font, items[i].label, items[i].lsize, &items[i].w, &h);
-		totw += items[i].w;
+	strncpy(wm->next_status, status, STATUS_LEN - 1);
+	wm->next_status[STATUS_LEN - 1] = '\0';
+
+	if (since >= FRAME_INTERVAL)
+		flush_status(wm);
+	else
+		schedule(wm, flush_status, FRAME_INTERVAL - since);
+}
+
+/* Each complete line written to the FIFO replaces the status. When many are
+ * read at once only the last one matters. */
+void read_status_fifo(Wm *wm)
+{
+	char buf[1024], line[STATUS_LEN];
+	ssize_t n;
+	int i, got = 0;
+
+	while ((n = read(wm->status_fd, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; i++) {
+			if (buf[i] != '\n') {
+				if (wm->fifo_len < STATUS_LEN - 1)
+					wm->fifo_buf[wm->fifo_len++] = buf[i];
+				continue;
+			}
+			wm->fifo_buf[wm->fifo_len] = '\0';
+			wm->fifo_len = 0;
+			strcpy(line, wm->fifo_buf);
+			got = 1;
+		}
 	}
 
-	XMoveResizeWindow(wm->dpy, bar->win, 0, 0, totw, toth);
-	drw_resize(bar->drw, totw, toth);
-	drw_text(bar->drw, 0, 0, wm->hid_w, toth, 0, hidt, 0);
-	drw_text(bar->drw, wm->hid_w, 0, wm->spawn_w, toth, 0, spawnt, 0);
+	if (got)
+		queue_status(wm, line);
+}
 
-	w = wm->hid_w + wm->spawn_w;
-	for (i = 0; i < LENGTH(items); i++) {
-		drw_text(bar->drw, w, 0, items[i].w, toth, 0, items[i].label, 0);
-		w += items[i].w;
+/* Reads a small file from /proc or /sys without stdio. Trailing newline is
+ * stripped. */
+int read_file(const char *path, char *buf, size_t len)
+{
+	ssize_t n;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return 0;
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	if (buf[n - 1] == '\n')
+		n--;
+	buf[n] = '\0';
+	return 1;
+}
+
+int status_clock(char *buf, size_t len, const char *arg, long long *state)
+{
+	time_t t = time(NULL);
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	return strftime(buf, len, arg, &tm) > 0;
+}
+
+int status_load(char *buf, size_t len, const char *arg, long long *state)
+{
+	char *sp;
+
+	if (!read_file("/proc/loadavg", buf, len))
+		return 0;
+	if ((sp = strchr(buf, ' ')) != NULL)
+		*sp = '\0';
+	return 1;
+}
+
+int status_memory(char *buf, size_t len, const char *arg, long long *state)
+{
+	char data[512];
+	char *p;
+	long long total, avail;
+
+	if (!read_file("/proc/meminfo", data, sizeof(data)))
+		return 0;
+	if ((p = strstr(data, "MemTotal:")) == NULL)
+		return 0;
+	total = strtoll(p + 9, NULL, 10);
+	if ((p = strstr(data, "MemAvailable:")) == NULL)
+		return 0;
+	avail = strtoll(p + 13, NULL, 10);
+	if (total <= 0)
+		return 0;
+
+	snprintf(buf, len, "%lld%%", (total - avail) * 100 / total);
+	return 1;
+}
+
+int status_battery(char *buf, size_t len, const char *arg, long long *state)
+{
+	char path[128], cap[8], st[32];
+
+	snprintf(path, sizeof(path), "/sys/class/power_supply/%s/capacity", arg);
+	if (!read_file(path, cap, sizeof(cap)))
+		return 0;
+	snprintf(path, sizeof(path), "/sys/class/power_supply/%s/status", arg);
+	if (!read_file(path, st, sizeof(st)))
+		st[0] = '\0';
+
+	snprintf(buf, len, "%s%s%%", strcmp(st, "Charging") == 0 ? "+" : "", cap);
+	return 1;
+}
+
+/* Shows the download/upload rates in KiB/s since the last update. */
+int status_network(char *buf, size_t len, const char *arg, long long *state)
+{
+	char path[128], num[32];
+	long long rx, tx, now = now_ms();
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/rx_bytes", arg);
+	if (!read_file(path, num, sizeof(num)))
+		return 0;
+	rx = strtoll(num, NULL, 10);
+	snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/tx_bytes", arg);
+	if (!read_file(path, num, sizeof(num)))
+		return 0;
+	tx = strtoll(num, NULL, 10);
+
+	if (state[2] == 0 || now <= state[2]) {
+		snprintf(buf, len, "%s", arg);
+	} else {
+		snprintf(buf,
+			len,
+			"%lldK/%lldK",
+			(rx - state[0]) * 1000 / 1024 / (now - state[2]),
+			(tx - state[1]) * 1000 / 1024 / (now - state[2]));
+	}
+	state[0] = rx;
+	state[1] = tx;
+	state[2] = now;
+	return 1;
+}
+
+/* Timer for the built-in status. Runs aligned to STATUS_INTERVAL on the wall
+ * clock so the clock component ticks on time. */
+void update_status(Wm *wm)
+{
+	char status[STATUS_LEN], buf[STATUS_LEN];
+	struct timespec ts;
+	long long ms, interval = STATUS_INTERVAL;
+	size_t len = 0;
+	int i;
+
+	/* Nobody would see it, uncover runs us again. */
+	if (wm->covered)
+		goto next;
+
+	status[0] = '\0';
+	for (i = 0; i < LENGTH(status_items); i++) {
+		if (!status_items[i].fn(buf, sizeof(buf), status_items[i].arg, status_items[i].state))
+			continue;
+		len += snprintf(
+			status + len,
+			sizeof(status) - len,
+			"%s%s",
+			len > 0 ? STATUS_SEPARATOR : "",
+			buf);
+		if (len >= sizeof(status))
+			break;
 	}
+	set_status(wm, status);
 
-	drw_map(bar->drw, bar->win, 0, 0, totw, toth);
+next:
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ms = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	schedule(wm, update_status, interval - ms % interval);
 }
 
-void render_title(Wm *wm, Client *c, short int focus)
+/* 0 = no opened, 1 = hidden, 2 = spawn. */
+void render_left_bar(Wm *wm, short int opened)
 {
-	Window _dumbw;
-	unsigned int w, h, _dumbu;
-	int _dumbi;
+	RenderJob *job;
+	RenderCell *cell;
+	Workspace *ws;
+	int i;
+	long long start = TRACE_BEGIN(wm);
+
+	if (wm->covered)
+		return;
+	/* With a single workspace there's nothing to switch to. */
+	job = new_job(2 + (WORKSPACES > 1 ? WORKSPACES : 0) + LENGTH(items));
+	cell = job->cells;
+	strcpy((cell++)->text, opened == 1 ? "[Hidden]" : " Hidden ");
+	strcpy((cell++)->text, opened == 2 ? "[Spawn] " : " Spawn  ");
+	for (ws = wm->workspaces; WORKSPACES > 1 && ws < wm->workspaces + WORKSPACES; ws++)
+		sprintf((cell++)->text, ws == wm->ws ? "[%d]" : " %d ", (int) (ws - wm->workspaces) + 1);
+	for (i = 0; i < LENGTH(items); i++)
+		sprintf((cell++)->text, "%.*s", (int) items[i].lsize, items[i].label);
+
+	render(wm, &wm->left_bar, job);
+	TRACE_END(wm, "render_left_bar", start);
+}
 
+/* The server paints titles and their buttons from their backgrounds, so the
+ * focus is the only thing that ever needs drawing. title_focus is what's
+ * painted, covered titles are left alone until uncover. */
+void render_title(Wm *wm, Client *c, short int focus)
+{
+	if (wm->covered || c->title_focus == focus)
+		return;
+	c->title_focus = focus;
 	XSetWindowBackground(wm->dpy, c->title, focus ? TITLE_FOCUS_COLOR : TITLE_COLOR);
 	XClearWindow(wm->dpy, c->title);
+}
+
+/* Tells the client where it is, since the frame moving it doesn't. */
+void send_configure(Wm *wm, Client *c)
+{
+	XConfigureEvent ce;
+
+	ce.type = ConfigureNotify;
+	ce.display = wm->dpy;
+	ce.event = c->id;
+	ce.window = c->id;
+	ce.x = c->x;
+	ce.y = c->y;
+	ce.width = c->w;
+	ce.height = c->h;
+	ce.border_width = BORDER_WIDTH;
+	ce.above = None;
+	ce.override_redirect = False;
+	XSendEvent(wm->dpy, c->id, False, StructureNotifyMask, (XEvent*) &ce);
+}
 
-	XGetGeometry(wm->dpy, c->title, &_dumbw, &_dumbi, &_dumbi, &w, &h, &_dumbu, &_dumbu);
+/* Moves and resizes the frame of c, so the client's outer corner is at x, y
+ * and its size w, h, with the title to its right. Only what changed is sent:
+ * a move is a single request. */
+void configure_client(Wm *wm, Client *c, int x, int y, int w, int h)
+{
+	if (w != c->w || h != c->h) {
+		XMoveResizeWindow(wm->dpy, c->frame, x, y, FRAME_W(w), FRAME_H(h));
+		XResizeWindow(wm->dpy, c->id, w, h);
+		XMoveResizeWindow(wm->dpy, c->title, w + BORDER_WIDTH * 2, 0, TITLE_WIDTH, h);
+	} else if (x != c->x || y != c->y) {
+		XMoveWindow(wm->dpy, c->frame, x, y);
+	} else {
+		return;
+	}
+	if (c->layer == LayerFloating)
+		wm->index.fresh = 0;
+	c->x = x;
+	c->y = y;
+	c->w = w;
+	c->h = h;
+	send_configure(wm, c);
+}
 
-	XSetForeground(wm->dpy, c->title_gc, CLOSE_BUTTON_COLOR);
-	XFillRectangle(wm->dpy, c->title, c->title_gc, 0, 0, w, w * 3);
-	XSetForeground(wm->dpy, c->title_gc, HIDE_BUTTON_COLOR);
-	XFillRectangle(wm->dpy, c->title, c->title_gc, 0, h - w * 3, w, w * 3);
+/* Focus is by click: every client but the focused one has the buttons
+ * grabbed, so clicking it reaches us first. */
+void set_grab(Wm *wm, Client *c, short int grab)
+{
+	if (c->grabbed == grab)
+		return;
+	c->grabbed = grab;
+	if (grab) {
+		XGrabButton(wm->dpy,
+			AnyButton,
+			AnyModifier,
+			c->id,
+			False,
+			ButtonPressMask,
+			GrabModeAsync,
+			GrabModeSync,
+			None,
+			None);
+	} else {
+		XUngrabButton(wm->dpy, AnyButton, AnyModifier, c->id);
+	}
+}
+
+/* Catches up with what wasn't drawn while a fullscreen window covered the
+ * screen: the bars and the titles of the workspace. */
+void uncover(Wm *wm)
+{
+	Client *c;
+
+	wm->covered = 0;
+	render_left_bar(wm, 0);
+	render_right_bar(wm);
+	if (STATUS_INTERVAL > 0)
+		update_status(wm);
+	for (c = wm->ws->floating; c != NULL; c = c->next)
+		render_title(wm, c, c == wm->focused);
+	for (c = wm->ws->tiled; c != NULL; c = c->next)
+		render_title(wm, c, c == wm->focused);
 }
 
 void restore_focus(Wm *wm)
 {
 	Client *c;
 	int height, title_x, i;
+	long long start;
 
-#define FORCLIENT(cli) \
-	for (c = (cli); c != NULL; c = c->next) { \
-		XGrabButton(wm->dpy, \
-			AnyButton, \
-			AnyModifier, \
-			c->id, \
-			False, \
-			ButtonPressMask, \
-			GrabModeAsync, \
-			GrabModeSync, \
-			None, \
-			None); \
-		render_title(wm, c, 0); \
+	if (wm->batch > 0) {
+		wm->relayout = 1;
+		return;
 	}
+	start = TRACE_BEGIN(wm);
 
-	FORCLIENT(wm->floating)
-	FORCLIENT(wm->tiled)
+	if (wm->covered && wm->ws->fullscreen == NULL)
+		uncover(wm);
+	wm->covered = wm->ws->fullscreen != NULL;
 
-	if (wm->current == NULL)
-		return;
+	/* Only the client losing the focus and the one getting it change. */
+	if (wm->focused != NULL && wm->focused != wm->ws->current) {
+		set_grab(wm, wm->focused, 1);
+		render_title(wm, wm->focused, 0);
+	}
+	wm->focused = wm->ws->current;
+
+	if (wm->ws->current == NULL)
+		goto out;
 
-	XRaiseWindow(wm->dpy, wm->current->id);
-	XRaiseWindow(wm->dpy, wm->current->title);
+	/* Tiled frames stay below, they're only lowered again when restacking. */
+	if (wm->ws->current->layer != LayerTiled)
+		XRaiseWindow(wm->dpy, wm->ws->current->frame);
 
-	if (wm->n_tiled == 0)
+	if (wm->ws->n_tiled == 0)
 		goto current;
 
-	XLowerWindow(wm->dpy, wm->tiled->id);
-	XLowerWindow(wm->dpy, wm->tiled->title);
-	if (wm->n_tiled == 1) {
-		XMoveResizeWindow(
-			wm->dpy,
-			wm->tiled->id,
+	if (wm->restack)
+		XLowerWindow(wm->dpy, wm->ws->tiled->frame);
+	if (wm->ws->n_tiled == 1) {
+		configure_client(
+			wm,
+			wm->ws->tiled,
 			0,
 			wm->bar_h + BORDER_WIDTH * 2,
 			wm->sw - BORDER_WIDTH * 4 - TITLE_WIDTH,
 			wm->sh - wm->bar_h - BORDER_WIDTH * 4);
-		XMoveResizeWindow(
-			wm->dpy,
-			wm->tiled->title,
-			wm->sw - BORDER_WIDTH * 2 - TITLE_WIDTH,
-			wm->bar_h + BORDER_WIDTH * 2,
-			TITLE_WIDTH,
-			wm->sh - wm->bar_h - BORDER_WIDTH * 4);
-		render_title(wm, wm->tiled, 0);
 		goto current;
 	}
 
-	XMoveResizeWindow(
-		wm->dpy,
-		wm->tiled->id,
+	configure_client(
+		wm,
+		wm->ws->tiled,
 		0,
 		wm->bar_h + BORDER_WIDTH * 2,
 		wm->sw / 2 - BORDER_WIDTH * 4 - TITLE_WIDTH,
 		wm->sh - wm->bar_h - BORDER_WIDTH * 4);
-	XMoveResizeWindow(
-		wm->dpy,
-		wm->tiled->title,
-		wm->sw / 2 - BORDER_WIDTH * 2 - TITLE_WIDTH,
-		wm->bar_h + BORDER_WIDTH * 2,
-		TITLE_WIDTH,
-		wm->sh - wm->bar_h - BORDER_WIDTH * 4);
-	render_title(wm, wm->tiled, 0);
 
-	height = (wm->sh - (wm->bar_h + BORDER_WIDTH * 2)) / (wm->n_tiled - 1);
+	height = (wm->sh - (wm->bar_h + BORDER_WIDTH * 2)) / (wm->ws->n_tiled - 1);
 	title_x = wm->sw - BORDER_WIDTH * 2 - TITLE_WIDTH;
 
 	i = 0;
-	for (c = wm->tiled->next; c != NULL; c = c->next) {
-		XLowerWindow(wm->dpy, c->id);
-		XLowerWindow(wm->dpy, c->title);
-		XMoveResizeWindow(
-			wm->dpy,
-			c->id,
+	for (c = wm->ws->tiled->next; c != NULL; c = c->next) {
+		if (wm->restack)
+			XLowerWindow(wm->dpy, c->frame);
+		configure_client(
+			wm,
+			c,
 			wm->sw / 2,
 			height * i + (wm->bar_h + BORDER_WIDTH * 2),
 			title_x - (wm->sw / 2 + BORDER_WIDTH * 2),
 			height - BORDER_WIDTH * 2);
-		XMoveResizeWindow(
-			wm->dpy,
-			c->title,
-			title_x,
-			height * i + (wm->bar_h + BORDER_WIDTH * 2),
-			TITLE_WIDTH,
-			height - BORDER_WIDTH * 2);
-		render_title(wm, c, 0);
 
 		i++;
 	}
 
 current:
-	XSetInputFocus(wm->dpy, wm->current->id, RevertToParent, CurrentTime);
-	XUngrabButton(wm->dpy, AnyButton, AnyModifier, wm->current->id);
-	render_title(wm, wm->current, 1);
+	wm->restack = 0;
+	XSetInputFocus(wm->dpy, wm->ws->current->id, RevertToParent, CurrentTime);
+	set_grab(wm, wm->ws->current, 0);
+	render_title(wm, wm->ws->current, 1);
+
+	if (wm->ws->fullscreen != NULL) {
+		configure_client(wm, wm->ws->fullscreen, -BORDER_WIDTH, -BORDER_WIDTH, wm->sw, wm->sh);
+		XRaiseWindow(wm->dpy, wm->ws->fullscreen->frame);
+	}
+
+out:
+	TRACE_END(wm, "restore_focus", start);
 }
 
-void fullscreen(Wm *wm)
+/* For qsort, by coordinate. */
+int cmp_edge(const void *a, const void *b)
+{
+	return ((const Edge *) a)->v - ((const Edge *) b)->v;
+}
+
+/* The four edges of a box, frame says whether it's a window's. */
+void add_edges(Index *ix, int x, int y, int w, int h, int frame)
+{
+	ix->x[ix->n] = (Edge) { x, y, y + h, frame ? w : 0 };
+	ix->y[ix->n++] = (Edge) { y, x, x + w, frame ? h : 0 };
+	ix->x[ix->n] = (Edge) { x + w, y, y + h, frame ? -w : 0 };
+	ix->y[ix->n++] = (Edge) { y + h, x, x + w, frame ? -h : 0 };
+	if (frame && w > ix->max_w)
+		ix->max_w = w;
+}
+
+/* Makes room for the edges of n boxes. */
+void grow_index(Index *ix, int n)
+{
+	if (n * 2 <= ix->cap)
+		return;
+	ix->cap = n * 2;
+	ix->x = realloc(ix->x, ix->cap * sizeof(Edge));
+	ix->y = realloc(ix->y, ix->cap * sizeof(Edge));
+	ix->rows = realloc(ix->rows, ix->cap * sizeof(int));
+	ix->cols = realloc(ix->cols, ix->cap * sizeof(int));
+	assert(ix->x != NULL && ix->y != NULL && ix->rows != NULL && ix->cols != NULL && "Buy more ram lol");
+}
+
+/* Fills the index with the frames floating on the workspace on screen but
+ * skip (and the fullscreen client, which isn't where its frame says), and
+ * the edges of the area below the bars to snap to. */
+void build_index(Wm *wm, Client *skip)
 {
-	Client *i;
+	Index *ix = &wm->index;
 	Client *c;
-	XEvent ev;
+	int n = 1;
+	int top = wm->bar_h + BORDER_WIDTH * 2;
+
+	for (c = wm->ws->floating; c != NULL; c = c->next)
+		n++;
+	grow_index(ix, n);
+
+	ix->n = 0;
+	ix->max_w = 0;
+	add_edges(ix, 0, top, wm->sw, wm->sh - top, 0);
+	for (c = wm->ws->floating; c != NULL; c = c->next) {
+		if (c != skip && c != wm->ws->fullscreen)
+			add_edges(ix, c->x, c->y, FRAME_W(c->w), FRAME_H(c->h), 1);
+	}
+	qsort(ix->x, ix->n, sizeof(Edge), cmp_edge);
+	qsort(ix->y, ix->n, sizeof(Edge), cmp_edge);
+	ix->fresh = skip == NULL;
+}
+
+/* Index of the first of the n sorted edges at v or after. */
+int first_edge(Edge *e, int n, int v)
+{
+	int a = 0, b = n, m;
+
+	while (a < b) {
+		m = (a + b) / 2;
+		if (e[m].v < v)
+			a = m + 1;
+		else
+			b = m;
+	}
+	return a;
+}
+
+/* Smallest move putting v on one of the edges that span some of lo..hi, or
+ * SNAP + 1 if none is within SNAP. */
+int snap_edge(Edge *e, int n, int v, int lo, int hi)
+{
+	int a, best = SNAP + 1;
+
+	for (a = first_edge(e, n, v - SNAP); a < n && e[a].v <= v + SNAP; a++) {
+		if (e[a].lo < hi && e[a].hi > lo && abs(e[a].v - v) < abs(best))
+			best = e[a].v - v;
+	}
+	return best;
+}
+
+/* Puts e among the n sorted edges. */
+void insert_edge(Edge *edges, int n, Edge e)
+{
+	int a = first_edge(edges, n, e.v);
 
-	if (wm->current == NULL)
+	memmove(&edges[a + 1], &edges[a], (n - a) * sizeof(Edge));
+	edges[a] = e;
+}
+
+/* Adds the frame of a client becoming floating to a fresh index, for the
+ * cost of moving the edges after it rather than of sorting them all. */
+void index_client(Wm *wm, Client *c)
+{
+	Index *ix = &wm->index;
+	int w = FRAME_W(c->w), h = FRAME_H(c->h);
+
+	if (!ix->fresh)
 		return;
-	XMoveResizeWindow(wm->dpy, wm->current->id, -BORDER_WIDTH, -BORDER_WIDTH, wm->sw, wm->sh);
-	XRaiseWindow(wm->dpy, wm->current->id);
+	grow_index(ix, ix->n / 2 + 1);
+	insert_edge(ix->x, ix->n, (Edge) { c->x, c->y, c->y + h, w });
+	insert_edge(ix->y, ix->n++, (Edge) { c->y, c->x, c->x + w, h });
+	insert_edge(ix->x, ix->n, (Edge) { c->x + w, c->y, c->y + h, -w });
+	insert_edge(ix->y, ix->n++, (Edge) { c->y + h, c->x, c->x + w, -h });
+	if (w > ix->max_w)
+		ix->max_w = w;
+}
 
-	for (;;) {
-		XSync(wm->dpy, False);
-		XNextEvent(wm->dpy, &ev);
+/* Snaps either side of a frame being moved. */
+void snap_move(Wm *wm, int *x, int *y, int w, int h)
+{
+	Index *ix = &wm->index;
+	int a, b;
 
-		switch (ev.type) {
-		case MapRequest:
-		case DestroyNotify:
-		case ButtonPress:
-			handle_event(wm, &ev);
+	if (SNAP <= 0)
+		return;
+	w = FRAME_W(w);
+	h = FRAME_H(h);
+	a = snap_edge(ix->x, ix->n, *x, *y, *y + h);
+	b = snap_edge(ix->x, ix->n, *x + w, *y, *y + h);
+	a = abs(a) < abs(b) ? a : b;
+	if (abs(a) <= SNAP)
+		*x += a;
+	a = snap_edge(ix->y, ix->n, *y, *x, *x + w);
+	b = snap_edge(ix->y, ix->n, *y + h, *x, *x + w);
+	a = abs(a) < abs(b) ? a : b;
+	if (abs(a) <= SNAP)
+		*y += a;
+}
+
+/* Snaps the right and bottom sides of a frame being resized. */
+void snap_resize(Wm *wm, int x, int y, int *w, int *h)
+{
+	Index *ix = &wm->index;
+	int d;
+
+	if (SNAP <= 0)
+		return;
+	d = snap_edge(ix->x, ix->n, x + FRAME_W(*w), y, y + FRAME_H(*h));
+	if (abs(d) <= SNAP && *w + d >= 1)
+		*w += d;
+	d = snap_edge(ix->y, ix->n, y + FRAME_H(*h), x, x + FRAME_W(*w));
+	if (abs(d) <= SNAP && *h + d >= 1)
+		*h += d;
+}
+
+/* Area of x, y, w, h covered by the frames in the index, stopping once it
+ * reaches limit (if it's not negative). Only frames whose left edge is
+ * within max_w of it are looked at. */
+long long overlap(Index *ix, int x, int y, int w, int h, long long limit)
+{
+	Edge *e;
+	long long sum = 0;
+	int a, ow, oh;
+
+	for (a = first_edge(ix->x, ix->n, x - ix->max_w); a < ix->n && ix->x[a].v < x + w; a++) {
+		e = &ix->x[a];
+		if (e->size <= 0)
+			continue;
+		ow = MIN(x + w, e->v + e->size) - MAX(x, e->v);
+		oh = MIN(y + h, e->hi) - MAX(y, e->lo);
+		if (ow <= 0 || oh <= 0)
+			continue;
+		sum += (long long) ow * oh;
+		if (limit >= 0 && sum >= limit)
 			break;
-		case KeyPress:
-			goto out;
-		}
 	}
-out:
-	for (i = wm->tiled; i != NULL; i = i->next) {
-		if (i == wm->current) {
-			restore_focus(wm);
-			return;
+	return sum;
+}
+
+/* Picks the req_x and req_y of a new client, which isn't floating yet, where
+ * its frame covers the least of the others. Candidates are the edges of the
+ * index, top to bottom and left to right, and the first spot covering
+ * nothing wins. With more than MAX_PLACE of them every other row or column
+ * is dropped, the axis with more first, so they still span the screen. */
+void smart_place(Wm *wm, Client *c)
+{
+	Index *ix = &wm->index;
+	int w = FRAME_W(c->req_w), h = FRAME_H(c->req_h);
+	int top = wm->bar_h + BORDER_WIDTH * 2;
+	int i, j, rows = 0, cols = 0, row_step = 1, col_step = 1;
+	long long o, best = -1;
+
+	if (!ix->fresh)
+		build_index(wm, NULL);
+	c->req_x = 0;
+	c->req_y = top;
+	for (i = 0; i < ix->n; i++) {
+		if ((i > 0 && ix->y[i].v == ix->y[i - 1].v) || ix->y[i].v < top)
+			continue;
+		/* Too tall for the screen, it goes at the top. */
+		if (ix->y[i].v + h > wm->sh && ix->y[i].v > top)
+			break;
+		ix->rows[rows++] = ix->y[i].v;
+	}
+	for (j = 0; j < ix->n; j++) {
+		if ((j > 0 && ix->x[j].v == ix->x[j - 1].v) || ix->x[j].v < 0)
+			continue;
+		if (ix->x[j].v + w > wm->sw && ix->x[j].v > 0)
+			break;
+		ix->cols[cols++] = ix->x[j].v;
+	}
+	while ((long) ((rows + row_step - 1) / row_step) * ((cols + col_step - 1) / col_step) > MAX_PLACE) {
+		if ((rows + row_step - 1) / row_step >= (cols + col_step - 1) / col_step)
+			row_step *= 2;
+		else
+			col_step *= 2;
+	}
+
+	for (i = 0; i < rows; i += row_step) {
+		for (j = 0; j < cols; j += col_step) {
+			o = overlap(ix, ix->cols[j], ix->rows[i], w, h, best);
+			if (best >= 0 && o >= best)
+				continue;
+			best = o;
+			c->req_x = ix->cols[j];
+			c->req_y = ix->rows[i];
+			if (best == 0)
+				return;
 		}
 	}
+}
 
-	c = wm->current;
-	XMoveResizeWindow(wm->dpy, c->id, c->req_x, c->req_y, c->req_w, c->req_h);
-	XMoveResizeWindow(
-		wm->dpy,
-		c->title,
-		c->req_x + c->req_w + BORDER_WIDTH * 2,
-		c->req_y,
-		TITLE_WIDTH,
-		c->req_h);
+/* Moves a floating client back to its requested geometry. */
+void place_client(Wm *wm, Client *c)
+{
+	configure_client(wm, c, c->req_x, c->req_y, c->req_w, c->req_h);
+}
+
+/* Makes c the fullscreen window of its workspace, or gives it back its
+ * geometry. While there's a fullscreen window restore_focus keeps it covering
+ * the screen. The client learns it through _NET_WM_STATE, and the compositor
+ * through _NET_WM_BYPASS_COMPOSITOR, so the window can be scanned out
+ * directly. */
+void set_fullscreen(Wm *wm, Client *c, int on)
+{
+	Workspace *ws = c->ws;
+	long bypass = 1;
+
+	if (on == (ws->fullscreen == c))
+		return;
+	/* The index leaves fullscreen frames out. */
+	wm->index.fresh = 0;
+
+	if (on) {
+		if (ws->fullscreen != NULL)
+			set_fullscreen(wm, ws->fullscreen, 0);
+		ws->fullscreen = c;
+		XChangeProperty(wm->dpy, c->id, wm->atoms[NetWMState], XA_ATOM, 32, PropModeReplace, (unsigned char*) &wm->atoms[NetWMStateFullscreen], 1);
+		XChangeProperty(wm->dpy, c->id, wm->atoms[NetWMBypassCompositor], XA_CARDINAL, 32, PropModeReplace, (unsigned char*) &bypass, 1);
+	} else {
+		ws->fullscreen = NULL;
+		/* It was raised over everything. */
+		wm->restack = 1;
+		XChangeProperty(wm->dpy, c->id, wm->atoms[NetWMState], XA_ATOM, 32, PropModeReplace, NULL, 0);
+		XDeleteProperty(wm->dpy, c->id, wm->atoms[NetWMBypassCompositor]);
+		if (c->layer == LayerFloating)
+			place_client(wm, c);
+	}
+	restore_focus(wm);
+}
+
+/* Toggles fullscreen of the current window. */
+void fullscreen(Wm *wm)
+{
+	if (wm->ws->fullscreen != NULL)
+		set_fullscreen(wm, wm->ws->fullscreen, 0);
+	else if (wm->ws->current != NULL)
+		set_fullscreen(wm, wm->ws->current, 1);
+}
+
+void unhide_client(Wm *wm, Client *c)
+{
+	op_begin(wm, OpUnhide);
+	place_client(wm, c);
+	XMapRaised(wm->dpy, c->frame);
+	c->ws = wm->ws;
+	set_layer(wm, c, LayerFloating);
+	wm->ws->current = c;
 	restore_focus(wm);
+	op_end(wm);
 }
 
 void unhide_by_idx(Wm *wm, int sel)
@@ -366,33 +2276,7 @@ void unhide_by_idx(Wm *wm, int sel)
 
 	for (; c != NULL; c = c->next) {
 		if (sel == 0) {
-			XMapRaised(wm->dpy, c->id);
-			XMapRaised(wm->dpy, c->title);
-			XMoveResizeWindow(wm->dpy, c->id, c->req_x, c->req_y, c->req_w, c->req_h);
-			XMoveResizeWindow(
-				wm->dpy,
-				c->title,
-				c->req_x + c->req_w + BORDER_WIDTH * 2,
-				c->req_y,
-				TITLE_WIDTH,
-				c->req_h);
-			if (c->prev != NULL)
-				c->prev->next = c->next;
-			if (c->next != NULL)
-				c->next->prev = c->prev;
-			if (wm->hidden == c) {
-				wm->hidden = c->prev;
-				if (wm->hidden == NULL)
-					wm->hidden = c->next;
-			}
-			c->prev = NULL;
-			if (wm->floating != NULL)
-				wm->floating->prev = c;
-			c->next = wm->floating;
-			wm->floating = c;
-			wm->current = c;
-			restore_focus(wm);
-			wm->n_hidden--;
+			unhide_client(wm, c);
 			return;
 		}
 
@@ -400,31 +2284,41 @@ void unhide_by_idx(Wm *wm, int sel)
 	}
 }
 
-int draw_hidden_menu(Wm *wm, int x, int y, int curx, int cury, unsigned int w, unsigned int h)
+/* Row of an n row menu at x, y under the pointer, -1 if none. */
+int menu_row(int x, int y, int curx, int cury, unsigned int w, unsigned int h, int n)
+{
+	int t = h / n;
+
+	if (curx < x || cury < y || curx >= x + w || cury >= y + t * n)
+		return -1;
+	return (cury - y) / t;
+}
+
+void draw_hidden_menu(Wm *wm, int sel, unsigned int w, unsigned int h)
 {
 	Client *c;
-	int in_menu = curx >= x && cury >= y && curx < x + w && cury < y + h;
+	RenderJob *job = new_job(wm->n_hidden);
+	RenderCell *cell = job->cells;
 	int i = 0;
 	int t = h / wm->n_hidden;
-	int r = -1;
+	long long start = TRACE_BEGIN(wm);
 
+	job->w = w;
+	job->h = h;
 	for (c = wm->hidden; c != NULL; c = c->next) {
-		if (in_menu && cury - y >= t * i && cury - y < t * (i + 1)) {
-			drw_setscheme(wm->menu.drw, wm->menu.color_f);
-			r = i;
-		} else {
-			drw_setscheme(wm->menu.drw, wm->menu.color);
-		}
-
+		cell->focus = i == sel;
+		cell->y = t * i;
+		cell->w = w;
+		cell->h = t;
 		if (c->name != NULL)
-			drw_text(wm->menu.drw, 0, t * i, w, t, 0, c->name, 0);
+			snprintf(cell->text, sizeof(cell->text), "%s", c->name);
 
+		cell++;
 		i++;
 	}
 
-	drw_map(wm->menu.drw, wm->menu.win, 0, 0, w, h);
-
-	return r;
+	render(wm, &wm->menu, job);
+	TRACE_END(wm, "draw_hidden_menu", start);
 }
 
 void hidden_window(Wm *wm)
@@ -432,22 +2326,25 @@ void hidden_window(Wm *wm)
 	XEvent ev;
 	unsigned int w, h, _dumbu;
 	Window _dumbw;
-	int _dumbi, x, y, curx, cury;
+	int _dumbi, x, y, curx, cury, row;
 	int sel = -1;
+	/* Rows drawn, the menu is only redrawn when the selection or the
+	 * hidden windows change. */
+	int drawn = 0;
 
 	if (wm->n_hidden == 0)
 		return;
+	wm->interactive++;
 
 	XMapRaised(wm->dpy, wm->menu.win);
 
-	XGetGeometry(wm->dpy, wm->left_bar.win, &_dumbw, &_dumbi, &_dumbi, &w, &h, &_dumbu, &_dumbu);
+	ROUNDTRIP(wm, XGetGeometry(wm->dpy, wm->left_bar.win, &_dumbw, &_dumbi, &_dumbi, &w, &h, &_dumbu, &_dumbu));
 	x = 0;
 	y = h + BORDER_WIDTH * 2;
 	h = h * wm->n_hidden;
 	XMoveResizeWindow(wm->dpy, wm->menu.win, x, y, w, h);
-	drw_resize(wm->menu.drw, w, h * wm->n_hidden);
 
-	XGrabPointer(wm->dpy,
+	ROUNDTRIP(wm, XGrabPointer(wm->dpy,
 		wm->menu.win,
 		False,
 		PointerMotionMask | ButtonPressMask | ButtonReleaseMask,
@@ -455,11 +2352,10 @@ void hidden_window(Wm *wm)
 		GrabModeAsync,
 		None,
 		wm->cursors.left_ptr,
-		CurrentTime);
+		CurrentTime));
 
 	for (;;) {
-		XSync(wm->dpy, False);
-		XNextEvent(wm->dpy, &ev);
+		next_event(wm, &ev);
 
 		switch (ev.type) {
 		/* Draw window as soon as the button is released. */
@@ -467,30 +2363,21 @@ void hidden_window(Wm *wm)
 		case MotionNotify:
 			curx = ev.xbutton.x_root;
 			cury = ev.xbutton.y_root;
-			if (curx > x + w || cury > y + h)
+			if (curx > x + w || cury > y + h || wm->n_hidden == 0)
 				goto unmap;
-			sel = draw_hidden_menu(
-				wm,
-				x,
-				y,
-				curx,
-				cury,
-				w,
-				h);
+			row = menu_row(x, y, curx, cury, w, h, wm->n_hidden);
+			if (row != sel || drawn != wm->n_hidden) {
+				draw_hidden_menu(wm, row, w, h);
+				drawn = wm->n_hidden;
+			}
+			sel = row;
 			break;
 		case ButtonPress:
 			curx = ev.xbutton.x_root;
 			cury = ev.xbutton.y_root;
-			if (curx > x + w || cury > y + h)
+			if (curx > x + w || cury > y + h || wm->n_hidden == 0)
 				goto unmap;
-			sel = draw_hidden_menu(
-				wm,
-				x,
-				y,
-				curx,
-				cury,
-				w,
-				h);
+			sel = menu_row(x, y, curx, cury, w, h, wm->n_hidden);
 			goto unhide;
 		default:
 			handle_event(wm, &ev);
@@ -503,29 +2390,30 @@ unhide:
 unmap:
 	XUnmapWindow(wm->dpy, wm->menu.win);
 	XUngrabPointer(wm->dpy, CurrentTime);
+	wm->interactive--;
 }
 
-int draw_spawn_menu(Wm *wm, int x, int y, int curx, int cury, unsigned int w, unsigned int h)
+void draw_spawn_menu(Wm *wm, int sel, unsigned int w, unsigned int h)
 {
-	int in_menu = curx >= x && cury >= y && curx < x + w && cury < y + h;
+	RenderJob *job = new_job(LENGTH(spawn_items));
+	RenderCell *cell;
 	int i;
 	int t = h / LENGTH(spawn_items);
-	int r = -1;
+	long long start = TRACE_BEGIN(wm);
 
+	job->w = w;
+	job->h = h;
 	for (i = 0; i < LENGTH(spawn_items); i++) {
-		if (in_menu && cury - y >= t * i && cury - y < t * (i + 1)) {
-			drw_setscheme(wm->menu.drw, wm->menu.color_f);
-			r = i;
-		} else {
-			drw_setscheme(wm->menu.drw, wm->menu.color);
-		}
-
-		drw_text(wm->menu.drw, 0, t * i, w, t, 0, spawn_items[i].label, 0);
+		cell = &job->cells[i];
+		cell->focus = i == sel;
+		cell->y = t * i;
+		cell->w = w;
+		cell->h = t;
+		sprintf(cell->text, "%.*s", (int) spawn_items[i].lsize, spawn_items[i].label);
 	}
 
-	drw_map(wm->menu.drw, wm->menu.win, 0, 0, w, h);
-
-	return r;
+	render(wm, &wm->menu, job);
+	TRACE_END(wm, "draw_spawn_menu", start);
 }
 
 void spawn_window(Wm *wm)
@@ -533,19 +2421,19 @@ void spawn_window(Wm *wm)
 	XEvent ev;
 	unsigned int w, h, _dumbu;
 	Window _dumbw;
-	int _dumbi, x, y, curx, cury;
-	int sel = -1;
+	int _dumbi, x, y, curx, cury, row;
+	int sel = -1, drawn = 0;
 
+	wm->interactive++;
 	XMapRaised(wm->dpy, wm->menu.win);
 
-	XGetGeometry(wm->dpy, wm->left_bar.win, &_dumbw, &_dumbi, &_dumbi, &w, &h, &_dumbu, &_dumbu);
+	ROUNDTRIP(wm, XGetGeometry(wm->dpy, wm->left_bar.win, &_dumbw, &_dumbi, &_dumbi, &w, &h, &_dumbu, &_dumbu));
 	x = 0;
 	y = h + BORDER_WIDTH * 2;
 	h = h * LENGTH(spawn_items);
 	XMoveResizeWindow(wm->dpy, wm->menu.win, x, y, w, h);
-	drw_resize(wm->menu.drw, w, h * LENGTH(spawn_items));
 
-	XGrabPointer(wm->dpy,
+	ROUNDTRIP(wm, XGrabPointer(wm->dpy,
 		wm->menu.win,
 		False,
 		PointerMotionMask | ButtonPressMask | ButtonReleaseMask,
@@ -553,11 +2441,10 @@ void spawn_window(Wm *wm)
 		GrabModeAsync,
 		None,
 		wm->cursors.left_ptr,
-		CurrentTime);
+		CurrentTime));
 
 	for (;;) {
-		XSync(wm->dpy, False);
-		XNextEvent(wm->dpy, &ev);
+		next_event(wm, &ev);
 
 		switch (ev.type) {
 		/* Draw window as soon as the button is released. */
@@ -567,44 +2454,32 @@ void spawn_window(Wm *wm)
 			cury = ev.xbutton.y_root;
 			if (curx > x + w || cury > y + h)
 				goto unmap;
-			sel = draw_spawn_menu(
-				wm,
-				x,
-				y,
-				curx,
-				cury,
-				w,
-				h);
+			row = menu_row(x, y, curx, cury, w, h, LENGTH(spawn_items));
+			if (row != sel || !drawn) {
+				draw_spawn_menu(wm, row, w, h);
+				drawn = 1;
+			}
+			sel = row;
 			break;
 		case ButtonPress:
 			curx = ev.xbutton.x_root;
 			cury = ev.xbutton.y_root;
 			if (curx > x + w || cury > y + h)
 				goto unmap;
-			sel = draw_spawn_menu(
-				wm,
-				x,
-				y,
-				curx,
-				cury,
-				w,
-				h);
+			sel = menu_row(x, y, curx, cury, w, h, LENGTH(spawn_items));
 			goto unhide;
 		default:
 			handle_event(wm, &ev);
 		}
 	}
 unhide:
-	if (sel > -1) {
-		if (fork() == 0) {
-			execvp(spawn_items[sel].command[0], (char * const *) spawn_items[sel].command);
-			exit(1);
-		}
-	}
+	if (sel > -1)
+		spawn(wm, spawn_items[sel].command);
 
 unmap:
 	XUnmapWindow(wm->dpy, wm->menu.win);
 	XUngrabPointer(wm->dpy, CurrentTime);
+	wm->interactive--;
 }
 
 void left_bar_click(Wm *wm, XButtonEvent *e)
@@ -623,103 +2498,295 @@ void left_bar_click(Wm *wm, XButtonEvent *e)
 		return;
 	}
 
+	for (i = 0; i < WORKSPACES; i++) {
+		w += wm->workspaces[i].w;
+		if (e->x < w) {
+			view_workspace(wm, &wm->workspaces[i]);
+			return;
+		}
+	}
+
 	for (i = 0; i < LENGTH(items); i++) {
 		w += items[i].w;
 		if (e->x < w) {
-			if (fork() == 0) {
-				execvp(items[i].command[0], (char * const *) items[i].command);
-				exit(1);
-			}
+			spawn(wm, items[i].command);
 			break;
 		}
 	}
 }
 
-void unmanage_floating(Wm *wm, Client *c)
+Client *alloc_client(Wm *wm)
 {
-	if (c->prev != NULL)
-		c->prev->next = c->next;
-	if (c->next != NULL)
-		c->next->prev = c->prev;
-	if (wm->floating == c)
-		wm->floating = c->next;
-	if (wm->current == c) {
-		if (c->next != NULL)
-			wm->current = c->next;
-		else if (c->prev != NULL)
-			wm->current = c->prev;
-		else if (wm->tiled != NULL)
-			wm->current = wm->tiled;
-		else
-			wm->current = NULL;
+	ClientChunk *chunk;
+	Client *c;
+	int i;
+
+	if (wm->free_clients == NULL) {
+		chunk = malloc(sizeof(ClientChunk));
+		assert(chunk != NULL && "Buy more ram lol");
+		chunk->next = wm->chunks;
+		wm->chunks = chunk;
+		/* In address order, so clients managed together sit together. */
+		for (i = CLIENT_CHUNK - 1; i >= 0; i--) {
+			chunk->clients[i].next = wm->free_clients;
+			wm->free_clients = &chunk->clients[i];
+		}
 	}
+	c = wm->free_clients;
+	wm->free_clients = c->next;
+	return c;
+}
+
+void free_client(Wm *wm, Client *c)
+{
+	c->next = wm->free_clients;
+	wm->free_clients = c;
+}
+
+/* Puts the client back on the root, where the frame was. */
+void unframe(Wm *wm, Client *c)
+{
+	XReparentWindow(wm->dpy, c->id, wm->root, c->x, c->y);
+	XRemoveFromSaveSet(wm->dpy, c->id);
+}
 
+/* A client that's still there (it just unmapped itself) gets its window back
+ * on the root. */
+void unmanage(Wm *wm, Client *c, int destroyed)
+{
+	int visible = c->layer != LayerHidden && c->ws == wm->ws;
+
+	set_layer(wm, c, LayerNone);
+	if (wm->focused == c)
+		wm->focused = NULL;
+	if (wm->dragged == c)
+		wm->dragged = NULL;
+	if (wm->resize.c == c) {
+		if (wm->resize.alarm != None)
+			XSyncDestroyAlarm(wm->dpy, wm->resize.alarm);
+		wm->resize.alarm = None;
+		wm->resize.c = NULL;
+	}
+	if (!destroyed)
+		unframe(wm, c);
 	if (c->name != NULL)
 		XFree(c->name);
-	XFreeGC(wm->dpy, c->title_gc);
-	XDestroyWindow(wm->dpy, c->title);
-	free(c);
+	remove_window(wm, c->id);
+	remove_window(wm, c->title);
+	remove_window(wm, c->frame);
+	/* Takes the title with it. */
+	XDestroyWindow(wm->dpy, c->frame);
+	free_client(wm, c);
+
+	if (visible)
+		restore_focus(wm);
+}
 
-	restore_focus(wm);
+#ifdef OUTLINE_DRAG
+/* Inverts the outline of the frame being dragged, so drawing it twice erases
+ * it. */
+void draw_outline(Wm *wm)
+{
+	XRectangle *r = &wm->outline;
+
+	XDrawRectangle(
+		wm->dpy,
+		wm->root,
+		wm->outline_gc,
+		r->x,
+		r->y,
+		FRAME_W(r->width) - 1,
+		FRAME_H(r->height) - 1);
 }
+#endif
 
-void unmanage_tiled(Wm *wm, Client *c)
-{
-	if (c->prev != NULL)
-		c->prev->next = c->next;
-	if (c->next != NULL)
-		c->next->prev = c->prev;
-	if (wm->tiled == c)
-		wm->tiled = c->next;
-	if (wm->current == c) {
-		if (c->next != NULL)
-			wm->current = c->next;
-		else if (c->prev != NULL)
-			wm->current = c->prev;
-		else if (wm->floating != NULL)
-			wm->current = wm->floating;
-		else
-			wm->current = NULL;
+/* The server is grabbed while there's an outline, so nothing draws over it
+ * and leaves trails when it's erased. */
+void begin_drag(Wm *wm, Client *c)
+{
+	wm->dragged = c;
+#ifdef OUTLINE_DRAG
+	XGrabServer(wm->dpy);
+	wm->server_grabbed = 1;
+	wm->outline.x = c->x;
+	wm->outline.y = c->y;
+	wm->outline.width = c->w;
+	wm->outline.height = c->h;
+	draw_outline(wm);
+#endif
+}
+
+/* A step of a move or resize. With OUTLINE_DRAG only the outline follows the
+ * pointer, and the client is configured once by end_drag. */
+void drag_client(Wm *wm, Client *c, int x, int y, int w, int h)
+{
+#ifdef OUTLINE_DRAG
+	draw_outline(wm);
+	wm->outline.x = x;
+	wm->outline.y = y;
+	wm->outline.width = w;
+	wm->outline.height = h;
+	draw_outline(wm);
+#else
+	if (c == wm->resize.c) {
+		wm->resize.w = w;
+		wm->resize.h = h;
+		flush_resize(wm);
+		return;
 	}
+	configure_client(wm, c, x, y, w, h);
+#endif
+}
 
-	if (c->name != NULL)
-		XFree(c->name);
-	XFreeGC(wm->dpy, c->title_gc);
-	XDestroyWindow(wm->dpy, c->title);
-	free(c);
+/* Returns 0 if the client was unmanaged during the drag, and c is gone. */
+int end_drag(Wm *wm, Client *c)
+{
+#ifdef OUTLINE_DRAG
+	draw_outline(wm);
+	XUngrabServer(wm->dpy);
+	wm->server_grabbed = 0;
+	submit_renders(wm);
+#endif
+	if (wm->dragged == NULL)
+		return 0;
+	wm->dragged = NULL;
+#ifdef OUTLINE_DRAG
+	configure_client(wm, c, wm->outline.x, wm->outline.y, wm->outline.width, wm->outline.height);
+#endif
+	return 1;
+}
 
-	wm->n_tiled--;
-	restore_focus(wm);
+/* Watches the client's _NET_WM_SYNC_REQUEST_COUNTER, if it has one, so
+ * flush_resize knows when it has drawn the last size. */
+void start_resize(Wm *wm, Client *c)
+{
+#ifndef OUTLINE_DRAG
+	Resize *r = &wm->resize;
+	XSyncAlarmAttributes aa;
+	XSyncValue value;
+	Atom *protocols, type;
+	int i, n, format, sync = 0;
+	unsigned long items, after;
+	unsigned char *data;
+
+	r->c = c;
+	r->w = c->w;
+	r->h = c->h;
+	r->at = 0;
+	r->waiting = 0;
+	r->alarm = None;
+	if (wm->sync_event < 0)
+		return;
+
+	if (ROUNDTRIP(wm, XGetWMProtocols(wm->dpy, c->id, &protocols, &n))) {
+		for (i = 0; i < n; i++)
+			sync |= protocols[i] == wm->atoms[NetWMSyncRequest];
+		XFree(protocols);
+	}
+	if (!sync)
+		return;
+	if (ROUNDTRIP(wm, XGetWindowProperty(wm->dpy, c->id, wm->atoms[NetWMSyncRequestCounter], 0, 1, False, XA_CARDINAL, &type, &format, &items, &after, &data)) != Success)
+		return;
+	if (items == 1 && format == 32)
+		r->counter = *(unsigned long *) data;
+	XFree(data);
+	if (items != 1 || format != 32)
+		return;
+
+	/* Requests go on from wherever the counter is. */
+	if (!ROUNDTRIP(wm, XSyncQueryCounter(wm->dpy, r->counter, &value)))
+		return;
+	r->value = (long long) value.hi << 32 | value.lo;
+	aa.trigger.counter = r->counter;
+	aa.trigger.value_type = XSyncAbsolute;
+	aa.trigger.test_type = XSyncPositiveComparison;
+	aa.trigger.wait_value = value;
+	XSyncIntsToValue(&aa.delta, 0, 0);
+	aa.events = True;
+	r->alarm = XSyncCreateAlarm(
+		wm->dpy,
+		XSyncCACounter | XSyncCAValueType | XSyncCATestType | XSyncCAValue | XSyncCADelta | XSyncCAEvents,
+		&aa);
+#endif
 }
 
-void unmanage_hidden(Wm *wm, Client *c)
+void stop_resize(Wm *wm)
 {
-	if (c->prev != NULL)
-		c->prev->next = c->next;
-	if (c->next != NULL)
-		c->next->prev = c->prev;
-	if (wm->hidden == c)
-		wm->hidden = c->next;
-	if (c->name != NULL)
-		XFree(c->name);
-	XFreeGC(wm->dpy, c->title_gc);
-	XDestroyWindow(wm->dpy, c->title);
-	free(c);
+	Resize *r = &wm->resize;
+
+	if (r->c == NULL)
+		return;
+	/* The final size goes without waiting. */
+	if (r->alarm != None)
+		XSyncDestroyAlarm(wm->dpy, r->alarm);
+	r->alarm = None;
+	r->waiting = 0;
+	r->at = 0;
+	flush_resize(wm);
+	r->c = NULL;
+}
+
+/* Gives the client being resized the latest size, if it's ready for it. Sync
+ * clients get one once they answered the previous (or SYNC_TIMEOUT passed),
+ * others at most one per FRAME_INTERVAL. */
+void flush_resize(Wm *wm)
+{
+	Resize *r = &wm->resize;
+	Client *c = r->c;
+	XSyncAlarmAttributes aa;
+	XEvent ev;
+	long long now = now_ms();
+
+	if (c == NULL || (r->w == c->w && r->h == c->h))
+		return;
+	if (r->alarm == None && now - r->at < FRAME_INTERVAL) {
+		schedule(wm, flush_resize, FRAME_INTERVAL - (now - r->at));
+		return;
+	}
+	if (r->waiting && now - r->at < SYNC_TIMEOUT)
+		return;
+
+	if (r->alarm != None) {
+		r->value++;
+		XSyncIntsToValue(&aa.trigger.wait_value, r->value & 0xffffffff, r->value >> 32);
+		XSyncChangeAlarm(wm->dpy, r->alarm, XSyncCAValue, &aa);
+
+		memset(&ev, 0, sizeof(ev));
+		ev.xclient.type = ClientMessage;
+		ev.xclient.window = c->id;
+		ev.xclient.message_type = wm->atoms[WMProtocols];
+		ev.xclient.format = 32;
+		ev.xclient.data.l[0] = wm->atoms[NetWMSyncRequest];
+		ev.xclient.data.l[1] = CurrentTime;
+		ev.xclient.data.l[2] = r->value & 0xffffffff;
+		ev.xclient.data.l[3] = r->value >> 32;
+		XSendEvent(wm->dpy, c->id, False, NoEventMask, &ev);
+		r->waiting = 1;
+		/* In case the answer never comes. */
+		schedule(wm, flush_resize, SYNC_TIMEOUT);
+	}
+	r->at = now;
+	configure_client(wm, c, c->x, c->y, r->w, r->h);
+}
+
+/* The client drew the size it got last. */
+void sync_alarm(Wm *wm, XEvent *ev)
+{
+	XSyncAlarmNotifyEvent *e = (XSyncAlarmNotifyEvent*) ev;
 
-	wm->n_hidden--;
+	if (wm->resize.c == NULL || e->alarm != wm->resize.alarm)
+		return;
+	wm->resize.waiting = 0;
+	flush_resize(wm);
 }
 
 void resize_client(Wm *wm, Client *c, int padx, int pady)
 {
 	XEvent ev;
 	XButtonEvent e;
-	int x, y;
-	Window _dumbw;
-	unsigned int w, h, _dumbu;
+	int x = c->x, y = c->y, w = c->w, h = c->h;
 
-	XGetGeometry(wm->dpy, c->id, &_dumbw, &x, &y, &w, &h, &_dumbu, &_dumbu);
-
-	XGrabPointer(
+	ROUNDTRIP(wm, XGrabPointer(
 		wm->dpy,
 		wm->root,
 		True,
@@ -728,11 +2795,15 @@ void resize_client(Wm *wm, Client *c, int padx, int pady)
 		GrabModeAsync,
 		None,
 		wm->cursors.sizing,
-		CurrentTime);
+		CurrentTime));
+	wm->interactive++;
+	if (SNAP > 0)
+		build_index(wm, c);
+	start_resize(wm, c);
+	begin_drag(wm, c);
 
 	for (;;) {
-		XSync(wm->dpy, False);
-		XNextEvent(wm->dpy, &ev);
+		next_event(wm, &ev);
 
 		switch (ev.type) {
 		case ButtonRelease:
@@ -742,32 +2813,39 @@ void resize_client(Wm *wm, Client *c, int padx, int pady)
 			e = ev.xbutton;
 			w = e.x_root - x - padx;
 			h = e.y_root - y + pady;
-			XResizeWindow(wm->dpy, c->id, w, h);
-			XMoveResizeWindow(wm->dpy, c->title, x + w + BORDER_WIDTH * 2, y, TITLE_WIDTH, h);
-			render_title(wm, c, 1);
+			if (w < 1)
+				w = 1;
+			if (h < 1)
+				h = 1;
+			snap_resize(wm, x, y, &w, &h);
+			op_begin(wm, OpDrag);
+			drag_client(wm, c, x, y, w, h);
+			op_end(wm);
 			break;
 		default:
 			handle_event(wm, &ev);
+			if (wm->dragged == NULL)
+				goto out;
 			break;
 		}
 	}
 out:
-	c->req_w = w;
-	c->req_h = h;
+	stop_resize(wm);
+	if (end_drag(wm, c)) {
+		c->req_w = w;
+		c->req_h = h;
+	}
 	XUngrabPointer(wm->dpy, CurrentTime);
+	wm->interactive--;
 }
 
 void move_client(Wm *wm, Client *c, int padx, int pady)
 {
 	XEvent ev;
 	XButtonEvent e;
-	int x, y;
-	Window _dumbw;
-	unsigned int _dumbu, w, h;
+	int x = c->x, y = c->y, w = c->w, h = c->h;
 
-	XGetGeometry(wm->dpy, c->id, &_dumbw, &x, &y, &w, &h, &_dumbu, &_dumbu);
-
-	XGrabPointer(
+	ROUNDTRIP(wm, XGrabPointer(
 		wm->dpy,
 		wm->root,
 		True,
@@ -776,11 +2854,14 @@ void move_client(Wm *wm, Client *c, int padx, int pady)
 		GrabModeAsync,
 		None,
 		wm->cursors.fleur,
-		CurrentTime);
+		CurrentTime));
+	wm->interactive++;
+	if (SNAP > 0)
+		build_index(wm, c);
+	begin_drag(wm, c);
 
 	for (;;) {
-		XSync(wm->dpy, False);
-		XNextEvent(wm->dpy, &ev);
+		next_event(wm, &ev);
 
 		switch (ev.type) {
 		case ButtonRelease:
@@ -790,159 +2871,129 @@ void move_client(Wm *wm, Client *c, int padx, int pady)
 			e = ev.xbutton;
 			x = e.x_root - w - padx;
 			y = e.y_root - h + pady;
-			XMoveWindow(wm->dpy, c->id, x, y);
-			XMoveWindow(wm->dpy, c->title, x + w + BORDER_WIDTH * 2, y);
-			render_title(wm, c, 1);
+			snap_move(wm, &x, &y, w, h);
+			op_begin(wm, OpDrag);
+			drag_client(wm, c, x, y, w, h);
+			op_end(wm);
 			break;
 		default:
 			handle_event(wm, &ev);
+			if (wm->dragged == NULL)
+				goto out;
 			break;
 		}
 	}
 out:
-	c->req_x = x;
-	c->req_y = y;
+	if (end_drag(wm, c)) {
+		c->req_x = x;
+		c->req_y = y;
+	}
 	XUngrabPointer(wm->dpy, CurrentTime);
+	wm->interactive--;
 }
 
 void hide_client(Wm *wm, Client *c)
 {
-	Client *i;
-
-	for (i = wm->tiled; i != NULL; i = i->next) {
-		if (i == c) {
-			wm->n_tiled--;
-			break;
-		}
-	}
-
-	if (c->prev != NULL)
-		c->prev->next = c->next;
-	if (c->next != NULL)
-		c->next->prev = c->prev;
-	if (wm->floating == c)
-		wm->floating = c->next;
-	if (wm->tiled == c)
-		wm->tiled = c->next;
-	if (wm->current == c) {
-		if (c->next != NULL)
-			wm->current = c->next;
-		else if (c->prev != NULL)
-			wm->current = c->prev;
-		else if (wm->tiled != NULL)
-			wm->current = wm->tiled;
-		else if (wm->floating != NULL)
-			wm->current = wm->floating;
-		else
-			wm->current = NULL;
-	}
-
-	c->next = wm->hidden;
-	if (wm->hidden != NULL)
-		wm->hidden->prev = c;
-	wm->hidden = c;
-	c->prev = NULL;
-	XUnmapWindow(wm->dpy, c->id);
-	XUnmapWindow(wm->dpy, c->title);
+	op_begin(wm, OpHide);
 
-	wm->n_hidden++;
+	set_fullscreen(wm, c, 0);
+	set_layer(wm, c, LayerHidden);
+	XUnmapWindow(wm->dpy, c->frame);
 
 	restore_focus(wm);
+	op_end(wm);
 }
 
-void tile_client(Wm *wm, Client *c)
+void toggle_tile(Wm *wm, Client *c)
 {
-	if (c->prev != NULL)
-		c->prev->next = c->next;
-	if (c->next != NULL)
-		c->next->prev = c->prev;
-	if (wm->floating == c)
-		wm->floating = c->next;
+	c->ws->current = c;
 
-	c->next = wm->tiled;
-	if (wm->tiled != NULL)
-		wm->tiled->prev = c;
-	c->prev = NULL;
-	wm->tiled = c;
-	wm->n_tiled++;
+	if (c->layer == LayerFloating) {
+		set_layer(wm, c, LayerTiled);
+	} else if (c->layer == LayerTiled) {
+		set_layer(wm, c, LayerFloating);
+		place_client(wm, c);
+	} else {
+		return;
+	}
+	restore_focus(wm);
 }
 
-void float_client(Wm *wm, Client *c)
+/* Makes c (or the next one if it's already there) the master. */
+void zoom_tiled_client(Wm *wm, Client *c)
 {
-	if (c->prev != NULL)
-		c->prev->next = c->next;
-	if (c->next != NULL)
-		c->next->prev = c->prev;
-	if (wm->tiled == c)
-		wm->tiled = c->next;
+	if (c == c->ws->tiled)
+		c = c->next;
+	if (c == NULL)
+		return;
 
-	c->next = wm->floating;
-	if (wm->floating != NULL)
-		wm->floating->prev = c;
-	c->prev = NULL;
-	wm->floating = c;
-	wm->n_tiled--;
+	set_layer(wm, c, LayerTiled);
+	c->ws->current = c;
 
-	XMoveResizeWindow(wm->dpy, c->id, c->req_x, c->req_y, c->req_w, c->req_h);
-	XMoveResizeWindow(
-		wm->dpy,
-		c->title,
-		c->req_x + c->req_w + BORDER_WIDTH * 2,
-		c->req_y,
-		TITLE_WIDTH,
-		c->req_h);
+	restore_focus(wm);
 }
 
-void toggle_tile(Wm *wm, Client *c)
+/* Shows ws instead of the workspace on screen in a single transition: every
+ * frame leaving is unmapped before any arriving is mapped, and the stacking,
+ * layout and focus are set once by restore_focus (or the commit of the batch
+ * we're in). Frames keep their stacking order while unmapped. */
+void view_workspace(Wm *wm, Workspace *ws)
 {
-	Client *i;
-	wm->current = c;
+	Client *c;
 
-	for (i = wm->floating; i != NULL; i = i->next) {
-		if (i == c) {
-			tile_client(wm, c);
-			restore_focus(wm);
-			return;
-		}
-	}
+	if (ws == wm->ws)
+		return;
+	op_begin(wm, OpWorkspace);
+	wm->index.fresh = 0;
+
+	for (c = wm->ws->floating; c != NULL; c = c->next)
+		XUnmapWindow(wm->dpy, c->frame);
+	for (c = wm->ws->tiled; c != NULL; c = c->next)
+		XUnmapWindow(wm->dpy, c->frame);
+
+	wm->ws = ws;
+	/* Clients sent here may have been stacked against other workspaces. */
+	wm->restack = 1;
+	for (c = ws->tiled; c != NULL; c = c->next)
+		XMapWindow(wm->dpy, c->frame);
+	for (c = ws->floating; c != NULL; c = c->next)
+		XMapWindow(wm->dpy, c->frame);
 
-	for (i = wm->tiled; i != NULL; i = i->next) {
-		if (i == c) {
-			float_client(wm, c);
-			restore_focus(wm);
-			return;
-		}
-	}
+	render_left_bar(wm, 0);
+	restore_focus(wm);
+	op_end(wm);
 }
 
-void zoom_tiled_client(Wm *wm, Client *c)
+/* Moves c to the same layer of ws. */
+void send_client(Wm *wm, Client *c, Workspace *ws)
 {
-	if (c == wm->tiled)
-		c = c->next;
-	if (c == NULL)
-		return;
+	int layer = c->layer;
 
-	if (c->next != NULL)
-		c->next->prev = c->prev;
-	if (c->prev != NULL)
-		c->prev->next = c->next;
-	c->prev = NULL;
-	c->next = wm->tiled;
-	wm->tiled->prev = c;
-	wm->tiled = c;
-	wm->current = c;
+	if (c->ws == ws)
+		return;
+	if (layer == LayerHidden) {
+		c->ws = ws;
+		return;
+	}
 
+	/* Like hiding, it leaves fullscreen behind, properties and all. */
+	set_fullscreen(wm, c, 0);
+	set_layer(wm, c, LayerNone);
+	c->ws = ws;
+	set_layer(wm, c, layer);
+	if (ws->current == NULL)
+		ws->current = c;
+	if (ws == wm->ws)
+		XMapWindow(wm->dpy, c->frame);
+	else
+		XUnmapWindow(wm->dpy, c->frame);
 	restore_focus(wm);
 }
 
+/* Clicks on the buttons are reported on the title. */
 void title_click(Wm *wm, Client *c, XButtonEvent *e)
 {
-	Window _dumbw;
-	unsigned int w, h, _dumbu;
-	int _dumbi;
-	Client *i;
-
-	XGetGeometry(wm->dpy, c->title, &_dumbw, &_dumbi, &_dumbi, &w, &h, &_dumbu, &_dumbu);
+	int w = TITLE_WIDTH, h = c->h;
 
 	if (e->y <= w * 3) {
 		if (e->button == Button3)
@@ -950,76 +3001,147 @@ void title_click(Wm *wm, Client *c, XButtonEvent *e)
 		else
 			hide_client(wm, c);
 	} else if (e->y >= h - w * 3) {
-		for (i = wm->tiled; i != NULL; i = i->next) {
-			if (i == c) {
-				zoom_tiled_client(wm, c);
-				return;
-			}
+		if (c->layer == LayerTiled) {
+			zoom_tiled_client(wm, c);
+			return;
 		}
 		resize_client(wm, c, e->x + BORDER_WIDTH * 2, h - e->y);
 	} else {
 		if (e->button == Button3) {
 			toggle_tile(wm, c);
 		} else {
-			for (i = wm->tiled; i != NULL; i = i->next) {
-				if (i == c) {
-					wm->current = c;
-					restore_focus(wm);
-					return;
-				}
+			if (c->layer == LayerTiled) {
+				wm->ws->current = c;
+				restore_focus(wm);
+				return;
 			}
 			move_client(wm, c, e->x + BORDER_WIDTH * 2, h - e->y);
 		}
 	}
 }
 
+/* Buttons are plain windows of their color inside the title. The gravity
+ * keeps the bottom one at the bottom when the title is resized. */
+void title_button(Wm *wm, Client *c, int y, unsigned long color, int gravity)
+{
+	XSetWindowAttributes wa;
+
+	wa.background_pixel = color;
+	wa.win_gravity = gravity;
+	XCreateWindow(
+		wm->dpy,
+		c->title,
+		0,
+		y,
+		TITLE_WIDTH,
+		TITLE_WIDTH * 3,
+		0,
+		CopyFromParent,
+		InputOutput,
+		CopyFromParent,
+		CWBackPixel | CWWinGravity,
+		&wa);
+}
+
 void manage(Wm *wm, Window win)
 {
 	XTextProperty prop;
+	XSizeHints hints;
 	unsigned int _dumbu, w, h;
 	Window _dumbw;
-	Client *new = malloc(sizeof(Client));
-	assert(new != NULL && "Buy more ram lol");
+	Atom type, *state;
+	int format, i, fs = 0;
+	unsigned long items, after;
+	long _dumbl;
+	Client *new = alloc_client(wm);
 
 	new->id = win;
 
-	XGetGeometry(wm->dpy, win, &_dumbw, &new->req_x, &new->req_y, &w, &h, &_dumbu, &_dumbu);
+	ROUNDTRIP(wm, XGetGeometry(wm->dpy, win, &_dumbw, &new->req_x, &new->req_y, &w, &h, &_dumbu, &_dumbu));
 	new->req_w = (int) w;
 	new->req_h = (int) h;
+	/* Unless the user or the program chose where it goes. */
+	if (!ROUNDTRIP(wm, XGetWMNormalHints(wm->dpy, win, &hints, &_dumbl))
+		|| !(hints.flags & (USPosition | PPosition)))
+	{
+		smart_place(wm, new);
+	}
 
 	new->name = NULL;
-	if (XGetWMName(wm->dpy, win, &prop))
+	if (ROUNDTRIP(wm, XGetWMName(wm->dpy, win, &prop)))
 		new->name = (char*) prop.value;
 
 	XSetWindowBorder(wm->dpy, win, BORDER_COLOR);
 	XSetWindowBorderWidth(wm->dpy, win, BORDER_WIDTH);
 
-	new->title = XCreateSimpleWindow(
+	/* The client and title exactly cover the frame. */
+	new->x = new->req_x;
+	new->y = new->req_y;
+	new->w = new->req_w;
+	new->h = new->req_h;
+	new->frame = XCreateSimpleWindow(
 		wm->dpy,
 		wm->root,
-		new->req_x + new->req_w + BORDER_WIDTH * 2,
-		new->req_y,
+		new->x,
+		new->y,
+		FRAME_W(new->w),
+		FRAME_H(new->h),
+		0,
+		BORDER_COLOR,
+		BORDER_COLOR);
+	new->title = XCreateSimpleWindow(
+		wm->dpy,
+		new->frame,
+		new->w + BORDER_WIDTH * 2,
+		0,
 		TITLE_WIDTH,
-		new->req_h,
+		new->h,
 		BORDER_WIDTH,
 		BORDER_COLOR,
 		TITLE_COLOR);
-	new->title_gc = XCreateGC(wm->dpy, new->title, 0, NULL);
-
-	XSelectInput(wm->dpy, new->title, ExposureMask | ButtonPressMask);
-	XSelectInput(wm->dpy, win, PointerMotionMask | PropertyChangeMask);
+	new->title_focus = 0;
+	new->grabbed = 0;
+	new->name_dirty = 0;
+	add_window(wm, win, new);
+	add_window(wm, new->title, new);
+	add_window(wm, new->frame, new);
+	set_grab(wm, new, 1);
+	title_button(wm, new, 0, CLOSE_BUTTON_COLOR, NorthWestGravity);
+	title_button(wm, new, new->h - TITLE_WIDTH * 3, HIDE_BUTTON_COLOR, SouthWestGravity);
+
+	/* Requests of the client now come through the frame, and so does it
+	 * unmapping itself. */
+	XSelectInput(wm->dpy, new->frame, SubstructureRedirectMask | SubstructureNotifyMask);
+	XSelectInput(wm->dpy, new->title, ButtonPressMask);
+	/* Only names. Focus is by click, through the passive grab in
+	 * restore_focus, so moving the pointer inside clients costs nothing. */
+	XSelectInput(wm->dpy, win, PropertyChangeMask);
+
+	/* If we die the server gives the client back to the root. */
+	XAddToSaveSet(wm->dpy, win);
+	XReparentWindow(wm->dpy, win, new->frame, 0, 0);
 
 	XMapWindow(wm->dpy, win);
+	XMapSubwindows(wm->dpy, new->title);
 	XMapWindow(wm->dpy, new->title);
-
-	if (wm->floating != NULL)
-		wm->floating->prev = new;
-	new->next = wm->floating;
-	new->prev = NULL;
-	wm->floating = new;
-	wm->current = new;
-
-	restore_focus(wm);
+	XMapWindow(wm->dpy, new->frame);
+	send_configure(wm, new);
+
+	new->layer = LayerNone;
+	new->ws = wm->ws;
+	set_layer(wm, new, LayerFloating);
+	wm->ws->current = new;
+
+	/* Games and players often ask for fullscreen before mapping. */
+	if (ROUNDTRIP(wm, XGetWindowProperty(wm->dpy, win, wm->atoms[NetWMState], 0, 32, False, XA_ATOM, &type, &format, &items, &after, (unsigned char**) &state)) == Success) {
+		for (i = 0; format == 32 && i < items; i++)
+			fs |= state[i] == wm->atoms[NetWMStateFullscreen];
+		XFree(state);
+	}
+	if (fs)
+		set_fullscreen(wm, new, 1);
+	else
+		restore_focus(wm);
 }
 
 void map_request(Wm *wm, XEvent *ev)
@@ -1028,29 +3150,44 @@ void map_request(Wm *wm, XEvent *ev)
 	XMapRequestEvent *e = &ev->xmaprequest;
 	if (e->window == wm->right_bar.win
 		|| e->window == wm->left_bar.win
-		|| e->window == wm->menu.win
-		|| !XGetWindowAttributes(wm->dpy, e->window, &wa)
-		|| wa.override_redirect
-		|| find_window(wm, e->window).c != NULL)
+		|| e->window == wm->menu.win)
 	{
 		return;
 	}
 
-	manage(wm, e->window);
+	op_begin(wm, OpManage);
+	if (ROUNDTRIP(wm, XGetWindowAttributes(wm->dpy, e->window, &wa))
+		&& !wa.override_redirect
+		&& find_window(wm, e->window).c == NULL)
+	{
+		manage(wm, e->window);
+	}
+	op_end(wm);
 }
 
 void destroy_notify(Wm *wm, XEvent *ev)
 {
 	XDestroyWindowEvent *e = &ev->xdestroywindow;
 	FindResult r = find_window(wm, e->window);
-	if (r.c != NULL) {
-		if (r.is_float)
-			unmanage_floating(wm, r.c);
-		if (r.is_hidden) {
-			unmanage_hidden(wm, r.c);
-		}
-		if (r.is_tiled)
-			unmanage_tiled(wm, r.c);
+	/* The client's own comes through the frame. */
+	if (r.c != NULL && !r.is_frame) {
+		op_begin(wm, OpUnmanage);
+		unmanage(wm, r.c, 1);
+		op_end(wm);
+	}
+}
+
+/* Clients are only unmapped by themselves (hiding unmaps the frame), which
+ * means they're withdrawing. */
+void unmap_notify(Wm *wm, XEvent *ev)
+{
+	XUnmapEvent *e = &ev->xunmap;
+	FindResult r = find_window(wm, e->window);
+
+	if (r.c != NULL && !r.is_title && !r.is_frame) {
+		op_begin(wm, OpUnmanage);
+		unmanage(wm, r.c, 0);
+		op_end(wm);
 	}
 }
 
@@ -1063,49 +3200,84 @@ void button_press(Wm *wm, XEvent *ev)
 
 	FindResult r = find_window(wm, e->window);
 	if (r.c != NULL) {
-		wm->current = r.c;
+		op_begin(wm, OpFocus);
+		wm->ws->current = r.c;
 		restore_focus(wm);
+		op_end(wm);
 		if (r.is_title)
 			title_click(wm, r.c, e);
 	}
 }
 
-void property_change(Wm *wm, XEvent *ev)
+/* Fetches the names marked by property_change, each once and as they are
+ * now. */
+void flush_properties(Wm *wm)
 {
 	XTextProperty prop;
-	XPropertyEvent *e = &ev->xproperty;
 	FindResult r;
-	if (e->window == wm->root) {
-		XFree(wm->status);
-		wm->status = NULL;
-		if (XGetWMName(wm->dpy, wm->root, &prop)) {
-			wm->status = (char*) prop.value;
-			render_right_bar(wm);
-		}
-	} else {
-		r = find_window(wm, e->window);
-		if (r.c != NULL && !r.is_title) {
-			if (r.c->name != NULL)
-				XFree(r.c->name);
-			r.c->name = NULL;
-			if (XGetWMName(wm->dpy, r.c->id, &prop))
-				r.c->name = (char*) prop.value;
+	int i;
+
+	wm->props_at = now_ms();
+	if (wm->status_dirty) {
+		wm->status_dirty = 0;
+		op_begin(wm, OpStatus);
+		if (ROUNDTRIP(wm, XGetWMName(wm->dpy, wm->root, &prop))) {
+			queue_status(wm, (char*) prop.value);
+			XFree(prop.value);
 		}
+		op_end(wm);
+	}
+
+	for (i = 0; i < wm->n_dirty; i++) {
+		r = find_window(wm, wm->dirty[i]);
+		/* Unmanaged since. */
+		if (r.c == NULL || !r.c->name_dirty)
+			continue;
+		r.c->name_dirty = 0;
+		if (r.c->name != NULL)
+			XFree(r.c->name);
+		r.c->name = NULL;
+		if (ROUNDTRIP(wm, XGetWMName(wm->dpy, r.c->id, &prop)))
+			r.c->name = (char*) prop.value;
 	}
+	wm->n_dirty = 0;
 }
 
-void expose(Wm *wm, XEvent *ev)
+/* Names are only marked here and fetched by flush_properties, once the
+ * events waiting are handled and at most once per FRAME_INTERVAL. A client
+ * retitling itself in a loop costs a fetch per frame however fast it
+ * goes. */
+void property_change(Wm *wm, XEvent *ev)
 {
-	XExposeEvent *e = &ev->xexpose;
+	XPropertyEvent *e = &ev->xproperty;
 	FindResult r;
+	long long since;
 
-	if (e->window == wm->right_bar.win)
-		render_right_bar(wm);
-	if (e->window == wm->left_bar.win)
-		render_left_bar(wm, 0);
-	r = find_window(wm, e->window);
-	if (r.is_title && r.c != NULL)
-		render_title(wm, r.c, r.c == wm->current);
+	if (e->atom != XA_WM_NAME)
+		return;
+	if (e->window == wm->root) {
+		/* The built-in status owns the bar. */
+		if (STATUS_INTERVAL > 0 || wm->status_dirty)
+			return;
+		wm->status_dirty = 1;
+	} else {
+		r = find_window(wm, e->window);
+		if (r.c == NULL || r.is_title || r.is_frame || r.c->name_dirty)
+			return;
+		r.c->name_dirty = 1;
+		if (wm->n_dirty == wm->cap_dirty) {
+			wm->cap_dirty = wm->cap_dirty ? wm->cap_dirty * 2 : 64;
+			wm->dirty = realloc(wm->dirty, wm->cap_dirty * sizeof(Window));
+			assert(wm->dirty != NULL && "Buy more ram lol");
+		}
+		wm->dirty[wm->n_dirty++] = r.c->id;
+	}
+
+	since = now_ms() - wm->props_at;
+	if (since >= FRAME_INTERVAL)
+		defer(wm, flush_properties);
+	else
+		schedule(wm, flush_properties, FRAME_INTERVAL - since);
 }
 
 void configure_request(Wm *wm, XEvent *ev)
@@ -1113,47 +3285,105 @@ void configure_request(Wm *wm, XEvent *ev)
 	XConfigureRequestEvent *e = &ev->xconfigurerequest;
 	FindResult r = find_window(wm, e->window);
 
-	if (r.c == NULL || r.is_title || r.is_tiled)
+	if (r.c == NULL || r.is_title || r.is_frame)
 		return;
+	/* Refused, but it must hear back. */
+	if (r.c->layer == LayerTiled) {
+		send_configure(wm, r.c);
+		return;
+	}
 
 	r.c->req_x = e->value_mask & CWX ? e->x : r.c->req_x;
 	r.c->req_y = e->value_mask & CWY ? e->y : r.c->req_y;
 	r.c->req_w = e->value_mask & CWWidth ? e->width : r.c->req_w;
 	r.c->req_h = e->value_mask & CWHeight ? e->height : r.c->req_h;
 
-	XMoveResizeWindow(wm->dpy, e->window, r.c->req_x, r.c->req_y, r.c->req_w, r.c->req_h);
-	XMoveResizeWindow(
-		wm->dpy,
-		r.c->title,
-		r.c->req_x + r.c->req_w + BORDER_WIDTH * 2,
-		r.c->req_y,
-		TITLE_WIDTH,
-		r.c->req_h);
+	if (r.c != r.c->ws->fullscreen
+		&& (r.c->req_x != r.c->x
+			|| r.c->req_y != r.c->y
+			|| r.c->req_w != r.c->w
+			|| r.c->req_h != r.c->h))
+	{
+		place_client(wm, r.c);
+	} else {
+		send_configure(wm, r.c);
+	}
+}
+
+/* Only _NET_WM_STATE requests, for fullscreen. data.l[0] is remove (0), add
+ * (1) or toggle (2) the states in l[1] and l[2]. */
+void client_message(Wm *wm, XEvent *ev)
+{
+	XClientMessageEvent *e = &ev->xclient;
+	Atom fs = wm->atoms[NetWMStateFullscreen];
+	FindResult r;
+	int on;
+
+	if (e->message_type != wm->atoms[NetWMState] || e->format != 32)
+		return;
+	if ((Atom) e->data.l[1] != fs && (Atom) e->data.l[2] != fs)
+		return;
+	r = find_window(wm, e->window);
+	if (r.c == NULL || r.is_title || r.is_frame || r.c->layer == LayerHidden)
+		return;
+
+	switch (e->data.l[0]) {
+	case 0:
+		on = 0;
+		break;
+	case 1:
+		on = 1;
+		break;
+	case 2:
+		on = r.c->ws->fullscreen != r.c;
+		break;
+	default:
+		return;
+	}
+	if (on)
+		r.c->ws->current = r.c;
+	set_fullscreen(wm, r.c, on);
 }
 
 void key_press(Wm *wm, XEvent *ev)
 {
 	XKeyEvent *e = &ev->xkey;
+	int i;
 
-	if (e->state == MODMASK && wm->fkey == e->keycode)
+	if (e->state != MODMASK)
+		return;
+	if (wm->fkey == e->keycode) {
 		fullscreen(wm);
+		return;
+	}
+	for (i = 0; i < WORKSPACES; i++) {
+		if (XKeysymToKeycode(wm->dpy, XK_1 + i) == e->keycode) {
+			view_workspace(wm, &wm->workspaces[i]);
+			return;
+		}
+	}
 }
 
 void handle_event(Wm *wm, XEvent *ev)
 {
+	if (ev->type == wm->sync_event) {
+		sync_alarm(wm, ev);
+		return;
+	}
+
 	switch (ev->type) {
 	case PropertyNotify:
 		property_change(wm, ev);
 		break;
-	case Expose:
-		expose(wm, ev);
-		break;
 	case MapRequest:
 		map_request(wm, ev);
 		break;
 	case DestroyNotify:
 		destroy_notify(wm, ev);
 		break;
+	case UnmapNotify:
+		unmap_notify(wm, ev);
+		break;
 	case ButtonPress:
 		button_press(wm, ev);
 		break;
@@ -1163,6 +3393,321 @@ void handle_event(Wm *wm, XEvent *ev)
 	case KeyPress:
 		key_press(wm, ev);
 		break;
+	case ClientMessage:
+		client_message(wm, ev);
+		break;
+	}
+}
+
+void begin_batch(Wm *wm)
+{
+	wm->batch++;
+}
+
+void end_batch(Wm *wm)
+{
+	if (--wm->batch == 0 && wm->relayout) {
+		wm->relayout = 0;
+		restore_focus(wm);
+	}
+}
+
+void close_control(Wm *wm, Control *ctl)
+{
+	if (ctl->batch)
+		end_batch(wm);
+	close(ctl->fd);
+	ctl->fd = -1;
+}
+
+/* Timer committing the batches of connections quiet for BATCH_TIMEOUT, and
+ * checking back for the others. */
+void expire_batches(Wm *wm)
+{
+	long long now = now_ms(), next = 0;
+	int i;
+
+	for (i = 0; i < MAX_CONTROL; i++) {
+		if (wm->ctl[i].fd < 0 || !wm->ctl[i].batch)
+			continue;
+		if (now - wm->ctl[i].at >= BATCH_TIMEOUT) {
+			wm->ctl[i].batch = 0;
+			wm->ctl[i].expired = 1;
+			end_batch(wm);
+		} else if (next == 0 || wm->ctl[i].at + BATCH_TIMEOUT < next) {
+			next = wm->ctl[i].at + BATCH_TIMEOUT;
+		}
+	}
+	if (next != 0)
+		schedule(wm, expire_batches, next - now);
+}
+
+Client *control_client(Wm *wm, const char *arg)
+{
+	char *end;
+	Window win;
+
+	if (arg == NULL)
+		return NULL;
+	if (strcmp(arg, "current") == 0)
+		return wm->ws->current;
+	win = strtoul(arg, &end, 0);
+	if (*end != '\0')
+		return NULL;
+	return find_window(wm, win).c;
+}
+
+void control_list(Wm *wm, Control *ctl)
+{
+	Client *c;
+	Workspace *ws;
+
+#define LISTCLIENT(cli, layer) \
+	for (c = (cli); c != NULL; c = c->next) { \
+		reply(ctl->fd, \
+			"0x%lx %s %d %s\n", \
+			c->id, \
+			layer, \
+			(int) (c->ws - wm->workspaces) + 1, \
+			c->name != NULL ? c->name : ""); \
+	}
+
+	for (ws = wm->workspaces; ws < wm->workspaces + WORKSPACES; ws++) {
+		LISTCLIENT(ws->floating, "floating")
+		LISTCLIENT(ws->tiled, "tiled")
+	}
+	LISTCLIENT(wm->hidden, "hidden")
+}
+
+/* Workspaces are numbered from 1, as in the bar. */
+Workspace *control_workspace(Wm *wm, const char *arg)
+{
+	char *end;
+	long n;
+
+	if (arg == NULL)
+		return NULL;
+	n = strtol(arg, &end, 10);
+	if (*end != '\0' || n < 1 || n > WORKSPACES)
+		return NULL;
+	return &wm->workspaces[n - 1];
+}
+
+/* Runs a single line from the control socket. Commands are:
+ * list, begin, commit, spawn CMD [ARGS...], workspace N, and focus, hide,
+ * unhide, tile, float, zoom, fullscreen, move X Y, resize W H, send N, taking
+ * a window first (its id or "current"). */
+void run_command(Wm *wm, Control *ctl, char *line)
+{
+	const char *argv[32];
+	char *cmd, *save;
+	int argc = 0;
+	Client *c;
+	Workspace *ws;
+
+	if ((cmd = strtok_r(line, " \t", &save)) == NULL)
+		return;
+	while (argc < LENGTH(argv) - 1 && (argv[argc] = strtok_r(NULL, " \t", &save)) != NULL)
+		argc++;
+	argv[argc] = NULL;
+
+	if (strcmp(cmd, "list") == 0) {
+		control_list(wm, ctl);
+		goto ok;
+	} else if (strcmp(cmd, "stats") == 0) {
+		dump_stats(wm, ctl->fd);
+		goto ok;
+	} else if (strcmp(cmd, "trace") == 0) {
+		if (argc == 0 || strcmp(argv[0], "off") == 0)
+			trace_stop(wm);
+		else if (!trace_start(wm, argv[0]))
+			goto usage;
+		goto ok;
+	} else if (strcmp(cmd, "record") == 0) {
+		if (argc == 0 || strcmp(argv[0], "off") == 0)
+			record_stop(wm);
+		else if (!record_start(wm, argv[0]))
+			goto usage;
+		goto ok;
+	} else if (strcmp(cmd, "begin") == 0) {
+		if (!ctl->batch) {
+			ctl->batch = 1;
+			ctl->expired = 0;
+			begin_batch(wm);
+			/* A pending deadline is earlier, and reschedules. */
+			if (!scheduled(wm, expire_batches))
+				schedule(wm, expire_batches, BATCH_TIMEOUT);
+		}
+		goto ok;
+	} else if (strcmp(cmd, "commit") == 0) {
+		if (ctl->expired) {
+			ctl->expired = 0;
+			reply(ctl->fd, "error: batch timed out\n");
+			return;
+		}
+		if (ctl->batch) {
+			ctl->batch = 0;
+			end_batch(wm);
+		}
+		goto ok;
+	} else if (strcmp(cmd, "spawn") == 0) {
+		if (argc == 0)
+			goto usage;
+		spawn(wm, argv);
+		goto ok;
+	} else if (strcmp(cmd, "workspace") == 0) {
+		if ((ws = control_workspace(wm, argv[0])) == NULL)
+			goto usage;
+		view_workspace(wm, ws);
+		goto ok;
+	}
+
+	if ((c = control_client(wm, argv[0])) == NULL) {
+		reply(ctl->fd, "error: no such window\n");
+		return;
+	}
+
+	if (strcmp(cmd, "focus") == 0) {
+		if (c->layer == LayerHidden)
+			goto hidden;
+		view_workspace(wm, c->ws);
+		wm->ws->current = c;
+		restore_focus(wm);
+	} else if (strcmp(cmd, "hide") == 0) {
+		if (c->layer != LayerHidden)
+			hide_client(wm, c);
+	} else if (strcmp(cmd, "unhide") == 0) {
+		if (c->layer == LayerHidden)
+			unhide_client(wm, c);
+	} else if (strcmp(cmd, "tile") == 0) {
+		if (c->layer == LayerHidden)
+			goto hidden;
+		if (c->layer == LayerFloating)
+			toggle_tile(wm, c);
+	} else if (strcmp(cmd, "float") == 0) {
+		if (c->layer == LayerHidden)
+			goto hidden;
+		if (c->layer == LayerTiled)
+			toggle_tile(wm, c);
+	} else if (strcmp(cmd, "zoom") == 0) {
+		if (c->layer != LayerTiled) {
+			reply(ctl->fd, "error: not tiled\n");
+			return;
+		}
+		zoom_tiled_client(wm, c);
+	} else if (strcmp(cmd, "fullscreen") == 0) {
+		if (c->layer == LayerHidden)
+			goto hidden;
+		view_workspace(wm, c->ws);
+		wm->ws->current = c;
+		set_fullscreen(wm, c, wm->ws->fullscreen != c);
+	} else if (strcmp(cmd, "move") == 0 || strcmp(cmd, "resize") == 0) {
+		if (argc != 3)
+			goto usage;
+		if (c->layer != LayerFloating) {
+			reply(ctl->fd, "error: not floating\n");
+			return;
+		}
+		if (cmd[0] == 'm') {
+			c->req_x = atoi(argv[1]);
+			c->req_y = atoi(argv[2]);
+		} else if (atoi(argv[1]) > 0 && atoi(argv[2]) > 0) {
+			c->req_w = atoi(argv[1]);
+			c->req_h = atoi(argv[2]);
+		} else {
+			goto usage;
+		}
+		if (c != c->ws->fullscreen)
+			place_client(wm, c);
+	} else if (strcmp(cmd, "send") == 0) {
+		if ((ws = control_workspace(wm, argv[1])) == NULL)
+			goto usage;
+		send_client(wm, c, ws);
+	} else {
+		reply(ctl->fd, "error: unknown command %s\n", cmd);
+		return;
+	}
+
+ok:
+	reply(ctl->fd, "ok\n");
+	return;
+hidden:
+	reply(ctl->fd, "error: hidden\n");
+	return;
+usage:
+	reply(ctl->fd, "error: bad arguments to %s\n", cmd);
+}
+
+/* All the lines read at once form a batch, and so do the ones between begin
+ * and commit. Either way there's a single relayout at the end. A begin whose
+ * connection then goes quiet for BATCH_TIMEOUT is committed anyway. */
+void read_control(Wm *wm, Control *ctl)
+{
+	char *nl;
+	ssize_t n;
+
+	begin_batch(wm);
+	for (;;) {
+		n = read(ctl->fd, ctl->buf + ctl->len, sizeof(ctl->buf) - ctl->len - 1);
+		if (n < 0 && errno == EAGAIN)
+			break;
+		if (n <= 0) {
+			close_control(wm, ctl);
+			break;
+		}
+		ctl->len += n;
+		ctl->buf[ctl->len] = '\0';
+		ctl->at = now_ms();
+
+		while ((nl = strchr(ctl->buf, '\n')) != NULL) {
+			*nl = '\0';
+			run_command(wm, ctl, ctl->buf);
+			ctl->len -= nl + 1 - ctl->buf;
+			memmove(ctl->buf, nl + 1, ctl->len + 1);
+		}
+		/* Line too long. */
+		if (ctl->len == sizeof(ctl->buf) - 1) {
+			reply(ctl->fd, "error: line too long\n");
+			ctl->len = 0;
+		}
+	}
+	end_batch(wm);
+}
+
+void accept_control(Wm *wm)
+{
+	struct epoll_event ev;
+	int i, fd;
+
+	while ((fd = accept4(wm->ctl_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		for (i = 0; i < MAX_CONTROL && wm->ctl[i].fd >= 0; i++);
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (i == MAX_CONTROL || epoll_ctl(wm->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			close(fd);
+			continue;
+		}
+		wm->ctl[i].fd = fd;
+		wm->ctl[i].batch = 0;
+		wm->ctl[i].expired = 0;
+		wm->ctl[i].at = now_ms();
+		wm->ctl[i].len = 0;
+	}
+}
+
+void control_event(Wm *wm, int fd)
+{
+	int i;
+
+	if (fd == wm->ctl_fd) {
+		accept_control(wm);
+		return;
+	}
+	for (i = 0; i < MAX_CONTROL; i++) {
+		if (wm->ctl[i].fd == fd) {
+			read_control(wm, &wm->ctl[i]);
+			return;
+		}
 	}
 }
 
@@ -1171,52 +3716,233 @@ void main_loop(Wm *wm)
 	XEvent ev;
 
 	for (;;) {
-		XSync(wm->dpy, False);
-		XNextEvent(wm->dpy, &ev);
+		next_event(wm, &ev);
 		handle_event(wm, &ev);
 	}
 }
 
+void init_loop_or_die(Wm *wm)
+{
+	struct epoll_event ev;
+	sigset_t mask;
+	int i;
+
+	for (i = 0; i < MAX_TIMERS; i++)
+		wm->timers[i].at = 0;
+	wm->queue_len = 0;
+	wm->n_idle = 0;
+	wm->idle_at = 0;
+	wm->interactive = 0;
+	wm->server_grabbed = 0;
+	wm->trace = NULL;
+	if (getenv("BARIGUI_TRACE") != NULL)
+		trace_start(wm, getenv("BARIGUI_TRACE"));
+	wm->record = NULL;
+	if (getenv("BARIGUI_RECORD") != NULL)
+		record_start(wm, getenv("BARIGUI_RECORD"));
+
+	/* Signals are only delivered through the signalfd. spawn() unblocks
+	 * them again for children. */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	wm->epfd = epoll_create1(EPOLL_CLOEXEC);
+	wm->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	wm->sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (wm->epfd < 0 || wm->tfd < 0 || wm->sfd < 0)
+		exit(1);
+
+	ev.events = EPOLLIN;
+	ev.data.fd = ConnectionNumber(wm->dpy);
+	if (epoll_ctl(wm->epfd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0)
+		exit(1);
+	ev.data.fd = wm->tfd;
+	if (epoll_ctl(wm->epfd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0)
+		exit(1);
+	ev.data.fd = wm->sfd;
+	if (epoll_ctl(wm->epfd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0)
+		exit(1);
+}
+
+/* Places name in $XDG_RUNTIME_DIR, or /tmp if it's not set, with the
+ * display name (slashes made underscores) in place of a %s in it. */
+void runtime_path(Wm *wm, char *buf, size_t len, const char *name)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	char display[64], file[128], *p;
+
+	snprintf(display, sizeof(display), "%s", DisplayString(wm->dpy));
+	for (p = display; *p != '\0'; p++) {
+		if (*p == '/')
+			*p = '_';
+	}
+	snprintf(file, sizeof(file), name, display);
+	snprintf(buf, len, "%s/%s", dir != NULL ? dir : "/tmp", file);
+}
+
+/* The FIFO is opened for writing too so we don't get EOF every time a
+ * producer closes it. Failing here just disables the feed. */
+void init_status_fifo(Wm *wm)
+{
+#ifdef STATUS_FIFO
+	struct epoll_event ev;
+	struct stat st;
+	char path[256];
+
+	runtime_path(wm, path, sizeof(path), STATUS_FIFO);
+	if (mkfifo(path, 0600) < 0 && errno != EEXIST)
+		return;
+	wm->status_fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (wm->status_fd < 0)
+		return;
+	/* One left by someone else, in /tmp, would let them feed the bar. */
+	if (fstat(wm->status_fd, &st) < 0 || !S_ISFIFO(st.st_mode) || st.st_uid != getuid())
+		goto fail;
+
+	ev.events = EPOLLIN;
+	ev.data.fd = wm->status_fd;
+	if (epoll_ctl(wm->epfd, EPOLL_CTL_ADD, wm->status_fd, &ev) < 0)
+		goto fail;
+	return;
+fail:
+	close(wm->status_fd);
+	wm->status_fd = -1;
+#endif
+}
+
+/* Like the status FIFO, failing here just disables the control socket. */
+void init_control(Wm *wm)
+{
+	int i;
+
+	wm->ctl_fd = -1;
+	wm->batch = 0;
+	wm->relayout = 0;
+	for (i = 0; i < MAX_CONTROL; i++)
+		wm->ctl[i].fd = -1;
+
+#ifdef CONTROL_SOCKET
+	struct epoll_event ev;
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	runtime_path(wm, addr.sun_path, sizeof(addr.sun_path), CONTROL_SOCKET);
+
+	wm->ctl_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (wm->ctl_fd < 0)
+		return;
+	/* Only a socket nobody listens on anymore is ours to replace. */
+	if (connect(wm->ctl_fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 || errno == EAGAIN)
+		goto fail;
+	close(wm->ctl_fd);
+	unlink(addr.sun_path);
+
+	wm->ctl_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (wm->ctl_fd < 0)
+		return;
+	if (bind(wm->ctl_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+		|| chmod(addr.sun_path, 0600) < 0
+		|| listen(wm->ctl_fd, MAX_CONTROL) < 0)
+	{
+		goto fail;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.fd = wm->ctl_fd;
+	if (epoll_ctl(wm->epfd, EPOLL_CTL_ADD, wm->ctl_fd, &ev) < 0)
+		goto fail;
+	return;
+fail:
+	close(wm->ctl_fd);
+	wm->ctl_fd = -1;
+#endif
+}
+
 void init_right_bar(Wm *wm)
 {
 	XTextProperty prop;
-	wm->status = NULL;
-	if (XGetWMName(wm->dpy, wm->root, &prop))
-		wm->status = (char*) prop.value;
+
+	wm->status[0] = '\0';
+	wm->status_at = 0;
+	wm->fifo_len = 0;
+	wm->status_fd = -1;
+	init_status_fifo(wm);
+
 	XMapWindow(wm->dpy, wm->right_bar.win);
-	render_right_bar(wm);
+	if (STATUS_INTERVAL > 0) {
+		update_status(wm);
+		return;
+	}
+	if (ROUNDTRIP(wm, XGetWMName(wm->dpy, wm->root, &prop))) {
+		set_status(wm, (char*) prop.value);
+		XFree(prop.value);
+	}
 }
 
+/* The layout comes back with the first render, and everything placed under
+ * the bar needs its height. */
 void init_left_bar(Wm *wm)
 {
-	unsigned int _dumbu;
-	Window _dumbw;
-	int _dumbi;
-
 	XMapWindow(wm->dpy, wm->left_bar.win);
 	render_left_bar(wm, 0);
-
-	XGetGeometry(wm->dpy, wm->left_bar.win, &_dumbw, &_dumbi, &_dumbi, &_dumbu, &wm->bar_h, &_dumbu, &_dumbu);
+	wait_render(wm, &wm->left_bar);
 }
 
-void init_dock_or_die(Wm *wm, Dock *dock)
+/* The fonts (only the first is opened, the rest are fallbacks opened when
+ * needed) and color schemes every dock is drawn with belong to the renderer,
+ * on a connection of its own. */
+void init_renderer_or_die(Wm *wm)
 {
-	long mask;
+	Renderer *r = &wm->render;
+	struct epoll_event ev;
 
-	dock->drw = drw_create(wm->dpy, wm->screen, wm->root, 10, 10);
-	if (dock->drw == NULL)
+	r->dpy = XOpenDisplay(DisplayString(wm->dpy));
+	if (r->dpy == NULL)
+		exit(1);
+	r->drw = drw_create(r->dpy, wm->screen, wm->root, 1, 1);
+	if (r->drw == NULL)
 		exit(1);
-	dock->font = drw_fontset_create(dock->drw, font, 1);
-	if (dock->font == NULL)
+	r->font = drw_fontset_create(r->drw, font, LENGTH(font));
+	if (r->font == NULL)
 		exit(1);
-	dock->color = drw_scm_create(dock->drw, color, 2);
-	if (dock->color == NULL)
+	r->color = drw_scm_create(r->drw, color, 2);
+	if (r->color == NULL)
 		exit(1);
-	dock->color_f = drw_scm_create(dock->drw, color_f, 2);
-	if (dock->color_f == NULL)
+	r->color_f = drw_scm_create(r->drw, color_f, 2);
+	if (r->color_f == NULL)
 		exit(1);
+	drw_setfontset(r->drw, r->font);
+
+	memset(&r->jobs, 0, sizeof(r->jobs));
+	memset(&r->done, 0, sizeof(r->done));
+	r->jobs_fd = eventfd(0, EFD_CLOEXEC);
+	r->space_fd = eventfd(0, EFD_CLOEXEC);
+	r->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (r->jobs_fd < 0 || r->space_fd < 0 || r->done_fd < 0)
+		exit(1);
+
+	ev.events = EPOLLIN;
+	ev.data.fd = r->done_fd;
+	if (epoll_ctl(wm->epfd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0)
+		exit(1);
+	if (pthread_create(&r->thread, NULL, render_thread, r) != 0)
+		exit(1);
+	startup_phase(wm, PhaseRenderer);
+}
+
+void init_dock_or_die(Wm *wm, Dock *dock)
+{
+	XSetWindowAttributes wa;
+	long mask;
 
-	drw_setscheme(dock->drw, dock->color);
+	dock->seq = 0;
+	dock->applied = 0;
+	dock->pending = NULL;
 	dock->win = XCreateSimpleWindow(
 		wm->dpy,
 		wm->root,
@@ -1227,30 +3953,70 @@ void init_dock_or_die(Wm *wm, Dock *dock)
 		BORDER_WIDTH,
 		BORDER_COLOR,
 		BAR_BACKGROUND);
-	mask = ExposureMask | ButtonPressMask;
+	mask = ButtonPressMask;
 	XSelectInput(wm->dpy, dock->win, mask);
+
+	/* Docks are painted by the server from their background pixmap (see
+	 * apply_renders), these only spare it some of that and what menus
+	 * cover from exposures when they go away. */
+	wa.backing_store = WhenMapped;
+	wa.save_under = True;
+	XChangeWindowAttributes(wm->dpy, dock->win, CWBackingStore | CWSaveUnder, &wa);
 }
 
-int main(void)
+/* Advertises what we do of EWMH. The check window names us and points to
+ * itself, as the root points to it, so stale ones can be told apart. */
+void init_ewmh(Wm *wm)
 {
-	Wm wm;
-
-	if (!(wm.dpy = XOpenDisplay(NULL)))
-		return 1;
-
-	wm.screen = DefaultScreen(wm.dpy);
-	wm.sw = DisplayWidth(wm.dpy, wm.screen);
-	wm.sh = DisplayHeight(wm.dpy, wm.screen);
-	wm.root = RootWindow(wm.dpy, wm.screen);
+	Atom supported[] = {
+		wm->atoms[NetWMState],
+		wm->atoms[NetWMStateFullscreen],
+		wm->atoms[NetSupportingWMCheck],
+	};
+
+	wm->wm_check = XCreateSimpleWindow(wm->dpy, wm->root, -1, -1, 1, 1, 0, 0, 0);
+	XChangeProperty(wm->dpy, wm->wm_check, wm->atoms[NetSupportingWMCheck], XA_WINDOW, 32, PropModeReplace, (unsigned char*) &wm->wm_check, 1);
+	XChangeProperty(wm->dpy, wm->wm_check, wm->atoms[NetWMName], wm->atoms[UTF8String], 8, PropModeReplace, (unsigned char*) "barigui", 7);
+	XChangeProperty(wm->dpy, wm->root, wm->atoms[NetSupportingWMCheck], XA_WINDOW, 32, PropModeReplace, (unsigned char*) &wm->wm_check, 1);
+	XChangeProperty(wm->dpy, wm->root, wm->atoms[NetSupported], XA_ATOM, 32, PropModeReplace, (unsigned char*) supported, LENGTH(supported));
+}
 
-	XStoreName(wm.dpy, wm.root, "barigui");
+/* Everything but opening the display, so the core can also run on a mock
+ * display (see corebench.c). */
+void setup(Wm *wm)
+{
+	int sync_base, _dumbi, i;
+#ifdef OUTLINE_DRAG
+	XGCValues gcv;
+#endif
 
-	wm.floating = NULL;
-	wm.tiled = NULL;
-	wm.hidden = NULL;
-	wm.current = NULL;
-	wm.n_tiled = 0;
-	wm.n_hidden = 0;
+	memset(&wm->stats, 0, sizeof(wm->stats));
+	startup_phase(wm, PhaseConnect);
+
+	wm->screen = DefaultScreen(wm->dpy);
+	wm->sw = DisplayWidth(wm->dpy, wm->screen);
+	wm->sh = DisplayHeight(wm->dpy, wm->screen);
+	wm->root = RootWindow(wm->dpy, wm->screen);
+
+	XStoreName(wm->dpy, wm->root, "barigui");
+
+	memset(wm->workspaces, 0, sizeof(wm->workspaces));
+	wm->ws = wm->workspaces;
+	wm->covered = 0;
+	wm->status_dirty = 0;
+	wm->dirty = NULL;
+	wm->n_dirty = 0;
+	wm->cap_dirty = 0;
+	wm->props_at = 0;
+	memset(&wm->index, 0, sizeof(wm->index));
+	wm->hidden = NULL;
+	wm->chunks = NULL;
+	wm->free_clients = NULL;
+	wm->windows = NULL;
+	wm->n_windows = 0;
+	wm->cap_windows = 0;
+	wm->focused = NULL;
+	wm->n_hidden = 0;
 
 	/* Register to get the events. */
 	long mask = SubstructureRedirectMask
@@ -1259,37 +4025,82 @@ int main(void)
 		| ButtonReleaseMask
 		| StructureNotifyMask
 		| PropertyChangeMask;
-	XSelectInput(wm.dpy, wm.root, mask);
-
-	init_dock_or_die(&wm, &wm.left_bar);
-	init_dock_or_die(&wm, &wm.right_bar);
-	init_dock_or_die(&wm, &wm.menu);
+	XSelectInput(wm->dpy, wm->root, mask);
+
+	init_dock_or_die(wm, &wm->left_bar);
+	init_dock_or_die(wm, &wm->right_bar);
+	init_dock_or_die(wm, &wm->menu);
+	startup_phase(wm, PhaseDocks);
+
+#ifdef OUTLINE_DRAG
+	gcv.function = GXinvert;
+	gcv.subwindow_mode = IncludeInferiors;
+	gcv.line_width = BORDER_WIDTH;
+	wm->outline_gc = XCreateGC(wm->dpy, wm->root, GCFunction | GCSubwindowMode | GCLineWidth, &gcv);
+#endif
 
 	/* Create the cursors. */
-	wm.cursors.left_ptr = XCreateFontCursor(wm.dpy, 68);
-	wm.cursors.fleur = XCreateFontCursor(wm.dpy, 52);
-	wm.cursors.sizing = XCreateFontCursor(wm.dpy, 120);
+	wm->cursors.left_ptr = XCreateFontCursor(wm->dpy, 68);
+	wm->cursors.fleur = XCreateFontCursor(wm->dpy, 52);
+	wm->cursors.sizing = XCreateFontCursor(wm->dpy, 120);
 
 #ifdef BACKGROUND
-	XSetWindowBackground(wm.dpy, wm.root, BACKGROUND);
-	XClearWindow(wm.dpy, wm.root);
+	XSetWindowBackground(wm->dpy, wm->root, BACKGROUND);
+	XClearWindow(wm->dpy, wm->root);
 #endif
-	XDefineCursor(wm.dpy, wm.root, wm.cursors.left_ptr);
+	XDefineCursor(wm->dpy, wm->root, wm->cursors.left_ptr);
 
-	/* Grab key. */
-	wm.fkey = XKeysymToKeycode(wm.dpy, FULLSCREEN_KEY);
-	XGrabKey(wm.dpy,
-		wm.fkey,
+	/* Grab keys. */
+	wm->fkey = XKeysymToKeycode(wm->dpy, FULLSCREEN_KEY);
+	XGrabKey(wm->dpy,
+		wm->fkey,
 		MODMASK,
-		wm.root,
+		wm->root,
 		True,
 		GrabModeAsync,
 		GrabModeAsync);
+	for (i = 0; i < WORKSPACES; i++) {
+		XGrabKey(wm->dpy,
+			XKeysymToKeycode(wm->dpy, XK_1 + i),
+			MODMASK,
+			wm->root,
+			True,
+			GrabModeAsync,
+			GrabModeAsync);
+	}
+
+	XInternAtoms(wm->dpy, atom_names, AtomLast, False, wm->atoms);
+	init_ewmh(wm);
+	wm->sync_event = -1;
+	wm->resize.c = NULL;
+	wm->dragged = NULL;
+	wm->restack = 0;
+	if (XSyncQueryExtension(wm->dpy, &sync_base, &_dumbi) && XSyncInitialize(wm->dpy, &_dumbi, &_dumbi))
+		wm->sync_event = sync_base + XSyncAlarmNotify;
 
 	XSetErrorHandler(error_handler);
+	init_loop_or_die(wm);
+	init_control(wm);
+	startup_phase(wm, PhaseLoop);
+
+	init_renderer_or_die(wm);
+	init_right_bar(wm);
+	init_left_bar(wm);
+	startup_phase(wm, PhaseBars);
+}
+
+int main(void)
+{
+	Wm wm;
 
-	init_right_bar(&wm);
-	init_left_bar(&wm);
+	/* The renderer thread has a connection of its own, but Xlib has
+	 * global state too. */
+	XInitThreads();
+	wm.started = now_ns();
+	if (!(wm.dpy = XOpenDisplay(NULL)))
+		return 1;
 
+	setup(&wm);
 	main_loop(&wm);
+	return 0;
 }
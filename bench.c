@@ -0,0 +1,724 @@
+#define _GNU_SOURCE
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XTest.h>
+#include <X11/keysym.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "record.h"
+
+/*
+ * bench.c - Headless benchmarks for barigui.
+ *
+ * Starts Xvfb and barigui on it, creates synthetic clients and drives barigui
+ * with XTest and its control socket. Every result is printed as a JSON object
+ * per line. Exits with 1 if barigui went over any round-trip budget.
+ *
+ * With -r it instead replays an event log recorded by barigui (see record.h),
+ * at the original speed or as fast as possible with -f, to reproduce and
+ * profile a session offline.
+ *
+ * Usage: barigui-bench [-n clients] [-d display] [-r log [-f]] path/to/barigui
+ */
+
+/*
+ * Copyright (C) 2024  Gabriel de Brito
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define LENGTH(X) (sizeof X / sizeof X[0])
+#define MAX_CLIENTS 256
+#define MAX_SAMPLES 1024
+/* Milliseconds to wait for barigui to react before giving up. */
+#define TIMEOUT 1000
+#define SCREEN_W 1280
+#define SCREEN_H 800
+/* Windows alive at once while replaying. */
+#define MAX_REPLAY 1024
+
+typedef struct {
+	long long v[MAX_SAMPLES];
+	int n;
+	int timeouts;
+} Samples;
+
+typedef struct {
+	Display *dpy;
+	Window root;
+	pid_t xvfb;
+	pid_t wm;
+	char runtime[64];
+	char sock[128];
+	char fifo[128];
+	Window wins[MAX_CLIENTS];
+	int n;
+	/* Two clients apart from the rest, for clicks and drags. */
+	Window a;
+	Window b;
+	XEvent ev;
+	/* Recorded window ids and the ones replaying them. */
+	uint32_t from[MAX_REPLAY];
+	Window to[MAX_REPLAY];
+} Bench;
+
+static Bench bench;
+
+long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void cleanup(void)
+{
+	if (bench.wm > 0)
+		kill(bench.wm, SIGTERM);
+	if (bench.xvfb > 0)
+		kill(bench.xvfb, SIGTERM);
+	while (wait(NULL) > 0);
+	if (bench.sock[0] != '\0')
+		unlink(bench.sock);
+	if (bench.fifo[0] != '\0')
+		unlink(bench.fifo);
+	if (bench.runtime[0] != '\0')
+		rmdir(bench.runtime);
+}
+
+void die(const char *msg)
+{
+	fprintf(stderr, "barigui-bench: %s\n", msg);
+	exit(2);
+}
+
+pid_t run(char *const argv[])
+{
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	return pid;
+}
+
+int cmp(const void *a, const void *b)
+{
+	long long x = *(const long long *) a, y = *(const long long *) b;
+
+	return (x > y) - (x < y);
+}
+
+void add(Samples *s, long long v)
+{
+	if (v < 0)
+		s->timeouts++;
+	else if (s->n < MAX_SAMPLES)
+		s->v[s->n++] = v;
+}
+
+void report(const char *name, const char *extra, Samples *s)
+{
+	long long sum = 0;
+	int i;
+
+	qsort(s->v, s->n, sizeof(s->v[0]), cmp);
+	for (i = 0; i < s->n; i++)
+		sum += s->v[i];
+
+	printf("{\"bench\":\"%s\",%s\"unit\":\"us\",\"samples\":%d,\"timeouts\":%d", name, extra, s->n, s->timeouts);
+	if (s->n > 0) {
+		printf(",\"mean\":%lld,\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"max\":%lld",
+			sum / s->n,
+			s->v[s->n / 2],
+			s->v[s->n * 9 / 10],
+			s->v[s->n * 99 / 100],
+			s->v[s->n - 1]);
+	}
+	printf("}\n");
+	fflush(stdout);
+	memset(s, 0, sizeof(*s));
+}
+
+/* Waits for an event of type on win (None for any window). Returns the
+ * microseconds since start, or -1 on timeout. */
+long long wait_event(Window win, int type, long long start)
+{
+	struct pollfd pfd;
+	long long left;
+
+	pfd.fd = ConnectionNumber(bench.dpy);
+	pfd.events = POLLIN;
+	for (;;) {
+		while (XPending(bench.dpy)) {
+			XNextEvent(bench.dpy, &bench.ev);
+			if (bench.ev.type == type && (win == None || bench.ev.xany.window == win))
+				return now_us() - start;
+		}
+		left = TIMEOUT - (now_us() - start) / 1000;
+		if (left <= 0 || poll(&pfd, 1, left) <= 0)
+			return -1;
+	}
+}
+
+/* Empties the queue so old events aren't taken as answers. */
+void drain(void)
+{
+	XSync(bench.dpy, False);
+	while (XPending(bench.dpy))
+		XNextEvent(bench.dpy, &bench.ev);
+}
+
+/* Sends a batch of commands and reads the whole answer into out. */
+int control(const char *cmds, char *out, size_t len)
+{
+	struct sockaddr_un addr;
+	size_t got = 0;
+	ssize_t n;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, bench.sock, sizeof(addr.sun_path) - 1);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return 0;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(fd);
+		return 0;
+	}
+	write(fd, cmds, strlen(cmds));
+	shutdown(fd, SHUT_WR);
+	while (out != NULL && got < len - 1 && (n = read(fd, out + got, len - 1 - got)) > 0)
+		got += n;
+	if (out != NULL)
+		out[got] = '\0';
+	close(fd);
+	return 1;
+}
+
+int controlf(const char *fmt, Window win)
+{
+	char cmd[128], out[128];
+
+	snprintf(cmd, sizeof(cmd), fmt, win);
+	return control(cmd, out, sizeof(out)) && strstr(out, "ok") != NULL;
+}
+
+void start(const char *display, const char *wm)
+{
+	char *xvfb[] = {
+		"Xvfb", (char *) display, "-screen", "0", "1280x800x24", "-nolisten", "tcp", NULL
+	};
+	char *barigui[] = { (char *) wm, NULL };
+	int i;
+
+	strcpy(bench.runtime, "/tmp/barigui-bench.XXXXXX");
+	if (mkdtemp(bench.runtime) == NULL)
+		die("can't create runtime dir");
+	setenv("XDG_RUNTIME_DIR", bench.runtime, 1);
+	setenv("DISPLAY", display, 1);
+	snprintf(bench.sock, sizeof(bench.sock), "%s/barigui-%s.sock", bench.runtime, display);
+	snprintf(bench.fifo, sizeof(bench.fifo), "%s/barigui-%s.status", bench.runtime, display);
+	atexit(cleanup);
+
+	bench.xvfb = run(xvfb);
+	for (i = 0; i < 100 && (bench.dpy = XOpenDisplay(display)) == NULL; i++)
+		usleep(50000);
+	if (bench.dpy == NULL)
+		die("can't start Xvfb");
+	bench.root = DefaultRootWindow(bench.dpy);
+
+	bench.wm = run(barigui);
+	for (i = 0; i < 100 && !control("list\n", NULL, 0); i++)
+		usleep(50000);
+	if (i == 100)
+		die("barigui didn't come up (is CONTROL_SOCKET enabled?)");
+
+	XSelectInput(bench.dpy, bench.root, SubstructureNotifyMask);
+}
+
+Window client(int x, int y, int w, int h)
+{
+	XSizeHints hints;
+	Window win;
+
+	win = XCreateSimpleWindow(bench.dpy, bench.root, x, y, w, h, 0, 0, 0xffffff);
+	/* So smart placement keeps it where we want it. */
+	hints.flags = USPosition | USSize;
+	hints.x = x;
+	hints.y = y;
+	hints.width = w;
+	hints.height = h;
+	XSetWMNormalHints(bench.dpy, win, &hints);
+	XStoreName(bench.dpy, win, "bench");
+	XSelectInput(bench.dpy, win, StructureNotifyMask | FocusChangeMask);
+	return win;
+}
+
+/* Creates the clients, timing each one from XMapWindow to getting focus. */
+void bench_map(void)
+{
+	Samples s = { 0 };
+	char extra[64];
+	long long t;
+	int i;
+
+	for (i = 0; i < bench.n; i++) {
+		bench.wins[i] = client(20 + (i * 8) % 800, 40 + (i * 2) % 300, 200, 100);
+		drain();
+		t = now_us();
+		XMapWindow(bench.dpy, bench.wins[i]);
+		XFlush(bench.dpy);
+		add(&s, wait_event(bench.wins[i], FocusIn, t));
+	}
+
+	bench.a = client(50, 400, 300, 300);
+	bench.b = client(700, 400, 300, 300);
+	XMapWindow(bench.dpy, bench.a);
+	XMapWindow(bench.dpy, bench.b);
+	wait_event(bench.b, FocusIn, now_us());
+
+	snprintf(extra, sizeof(extra), "\"clients\":%d,", bench.n);
+	report("map_to_focus", extra, &s);
+}
+
+void click(int x, int y, unsigned int button)
+{
+	XTestFakeMotionEvent(bench.dpy, -1, x, y, CurrentTime);
+	XTestFakeButtonEvent(bench.dpy, button, True, CurrentTime);
+	XTestFakeButtonEvent(bench.dpy, button, False, CurrentTime);
+	XFlush(bench.dpy);
+}
+
+/* Clicks a and b alternately, from the click until the focus arrives. */
+void bench_focus_click(void)
+{
+	Samples s = { 0 };
+	char extra[64];
+	long long t;
+	int i;
+
+	for (i = 0; i < 100; i++) {
+		drain();
+		t = now_us();
+		if (i % 2 == 0)
+			click(200, 550, Button1);
+		else
+			click(850, 550, Button1);
+		add(&s, wait_event(i % 2 == 0 ? bench.a : bench.b, FocusIn, t));
+	}
+
+	snprintf(extra, sizeof(extra), "\"clients\":%d,", bench.n + 2);
+	report("focus_click", extra, &s);
+}
+
+/* Tiles the clients one by one. Every relayout moves the first tiled client
+ * further down the stack, so it's done when that one is configured. */
+void bench_relayout(void)
+{
+	Samples s = { 0 };
+	char extra[64];
+	long long t;
+	int i, max = bench.n < 64 ? bench.n : 64;
+
+	for (i = 0; i < max; i++) {
+		drain();
+		t = now_us();
+		controlf("tile 0x%lx\n", bench.wins[i]);
+		add(&s, wait_event(bench.wins[0], ConfigureNotify, t));
+		snprintf(extra, sizeof(extra), "\"tiled\":%d,", i + 1);
+		report("tile_relayout", extra, &s);
+	}
+	for (i = 0; i < max; i++)
+		controlf("float 0x%lx\n", bench.wins[i]);
+}
+
+/* Drags a by its title, one pixel per motion, waiting for each frame. The
+ * title is what the frame has right of the client and its border. */
+void bench_drag(void)
+{
+	XWindowAttributes wa;
+	Samples s = { 0 };
+	Window frame, _dumbw, *children;
+	char extra[64];
+	long long t, start;
+	unsigned int frame_w, _dumbu;
+	int i, x, y, frames = 200;
+
+	XGetWindowAttributes(bench.dpy, bench.a, &wa);
+	XQueryTree(bench.dpy, bench.a, &_dumbw, &frame, &children, &_dumbu);
+	if (children != NULL)
+		XFree(children);
+	XGetGeometry(bench.dpy, frame, &_dumbw, &x, &y, &frame_w, &_dumbu, &_dumbu, &_dumbu);
+	x += (wa.width + wa.border_width * 2 + (int) frame_w) / 2;
+	y += wa.height / 2;
+
+	drain();
+	XTestFakeMotionEvent(bench.dpy, -1, x, y, CurrentTime);
+	XTestFakeButtonEvent(bench.dpy, Button1, True, CurrentTime);
+	XSync(bench.dpy, False);
+
+	start = now_us();
+	for (i = 1; i <= frames; i++) {
+		t = now_us();
+		XTestFakeMotionEvent(bench.dpy, -1, x + i, y + (i % 2), CurrentTime);
+		XFlush(bench.dpy);
+		add(&s, wait_event(bench.a, ConfigureNotify, t));
+	}
+	t = now_us() - start;
+	XTestFakeButtonEvent(bench.dpy, Button1, False, CurrentTime);
+	XSync(bench.dpy, False);
+
+	snprintf(extra, sizeof(extra), "\"fps\":%lld,", s.n * 1000000LL / (t > 0 ? t : 1));
+	report("drag_frame", extra, &s);
+}
+
+/* Opens the hidden menu from the left bar, until it's mapped. */
+void bench_hidden_menu(void)
+{
+	Samples s = { 0 };
+	long long t;
+	int i;
+
+	for (i = 0; i < 5 && i < bench.n; i++)
+		controlf("hide 0x%lx\n", bench.wins[i]);
+
+	for (i = 0; i < 50; i++) {
+		drain();
+		t = now_us();
+		click(5, 5, Button1);
+		add(&s, wait_event(None, MapNotify, t));
+		XTestFakeMotionEvent(bench.dpy, -1, SCREEN_W - 10, SCREEN_H - 10, CurrentTime);
+		XFlush(bench.dpy);
+		wait_event(None, UnmapNotify, now_us());
+	}
+	report("hidden_menu_open", "\"hidden\":5,", &s);
+
+	for (i = 0; i < 5 && i < bench.n; i++)
+		controlf("unhide 0x%lx\n", bench.wins[i]);
+}
+
+/* CPU time (in clock ticks) used by a process so far. */
+long long cpu_ticks(pid_t pid)
+{
+	char path[64], buf[1024], *p;
+	unsigned long utime, stime;
+	int fd, n, i;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return 0;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	buf[n] = '\0';
+	/* utime and stime are the 14th and 15th, counted after the name. */
+	if ((p = strrchr(buf, ')')) == NULL)
+		return 0;
+	for (i = 2; i < 14 && p != NULL; i++)
+		p = strchr(p + 1, ' ');
+	if (p == NULL || sscanf(p, " %lu %lu", &utime, &stime) != 2)
+		return 0;
+	return utime + stime;
+}
+
+/* Status updates through the root name and the FIFO, timed until the right
+ * bar is resized. Texts alternate in length so it always is. */
+void bench_status(void)
+{
+	static const char *texts[] = { "short", "a much longer status text" };
+	Samples s = { 0 };
+	char extra[64];
+	long long t, ticks;
+	int i, fd, updates = 100;
+
+	ticks = cpu_ticks(bench.wm);
+	for (i = 0; i < updates; i++) {
+		drain();
+		t = now_us();
+		XStoreName(bench.dpy, bench.root, texts[i % 2]);
+		XFlush(bench.dpy);
+		add(&s, wait_event(None, ConfigureNotify, t));
+		/* Stay clear of the frame coalescing. */
+		usleep(20000);
+	}
+	snprintf(extra,
+		sizeof(extra),
+		"\"cpu_us_per_update\":%lld,",
+		(cpu_ticks(bench.wm) - ticks) * 1000000 / sysconf(_SC_CLK_TCK) / updates);
+	report("status_root_name", extra, &s);
+
+	if ((fd = open(bench.fifo, O_WRONLY | O_NONBLOCK)) < 0)
+		return;
+	ticks = cpu_ticks(bench.wm);
+	for (i = 0; i < updates; i++) {
+		drain();
+		t = now_us();
+		dprintf(fd, "%s\n", texts[i % 2]);
+		add(&s, wait_event(None, ConfigureNotify, t));
+		usleep(20000);
+	}
+	close(fd);
+	snprintf(extra,
+		sizeof(extra),
+		"\"cpu_us_per_update\":%lld,",
+		(cpu_ticks(bench.wm) - ticks) * 1000000 / sysconf(_SC_CLK_TCK) / updates);
+	report("status_fifo", extra, &s);
+}
+
+/* Prints barigui's own X traffic accounting. Returns how many times any
+ * operation went over its round-trip budget. */
+long long bench_budgets(void)
+{
+	char out[16384], name[32], *line, *p;
+	unsigned long long count, over;
+	double requests, round_trips;
+	long long total = 0;
+
+	if (!control("stats\n", out, sizeof(out)) || (line = strstr(out, "X traffic")) == NULL)
+		return 0;
+
+	while ((line = strchr(line, '\n')) != NULL && *++line != '\0' && strncmp(line, "X errors", 8) != 0) {
+		/* Names may have a space, the count is what follows them. */
+		if ((p = strstr(line, " count ")) == NULL)
+			break;
+		snprintf(name, sizeof(name), "%.*s", (int) (p - line), line);
+		while (strlen(name) > 0 && name[strlen(name) - 1] == ' ')
+			name[strlen(name) - 1] = '\0';
+		if (sscanf(p, " count %llu requests %lf (max %*u) round trips %lf (max %*u, budget %*d, over %llu)",
+			&count, &requests, &round_trips, &over) != 4)
+		{
+			continue;
+		}
+		printf("{\"bench\":\"x_traffic\",\"op\":\"%s\",\"count\":%llu,\"requests\":%.1f,\"round_trips\":%.1f,\"over_budget\":%llu}\n",
+			name, count, requests, round_trips, over);
+		total += over;
+	}
+	return total;
+}
+
+/* Looks up a recorded window. With add, a free slot is returned for it. */
+int replay_slot(uint32_t id, int add)
+{
+	int i;
+
+	for (i = 0; i < MAX_REPLAY; i++) {
+		if (bench.to[i] != None && bench.from[i] == id)
+			return i;
+	}
+	if (!add)
+		return -1;
+	for (i = 0; i < MAX_REPLAY; i++) {
+		if (bench.to[i] == None)
+			return i;
+	}
+	return -1;
+}
+
+void replay_entry(RecordEntry *r, const char *name)
+{
+	XWindowChanges wc;
+	XEvent ev;
+	KeyCode super = XKeysymToKeycode(bench.dpy, XK_Super_L);
+	int i = replay_slot(r->window, r->type == MapRequest), j;
+	char copy[1024], *type, *atom, *save;
+
+	switch (r->type) {
+	case MapRequest:
+		if (i < 0)
+			return;
+		/* Mapped again after withdrawing. */
+		if (bench.to[i] != None) {
+			XMapWindow(bench.dpy, bench.to[i]);
+			break;
+		}
+		bench.from[i] = r->window;
+		bench.to[i] = client(r->x, r->y, r->w > 0 ? r->w : 1, r->h > 0 ? r->h : 1);
+		XStoreName(bench.dpy, bench.to[i], name);
+		XMapWindow(bench.dpy, bench.to[i]);
+		break;
+	case DestroyNotify:
+		if (i < 0)
+			return;
+		XDestroyWindow(bench.dpy, bench.to[i]);
+		bench.to[i] = None;
+		break;
+	case UnmapNotify:
+		if (i < 0)
+			return;
+		XUnmapWindow(bench.dpy, bench.to[i]);
+		break;
+	case ClientMessage:
+		snprintf(copy, sizeof(copy), "%s", name);
+		if (i < 0 || (type = strtok_r(copy, " ", &save)) == NULL)
+			return;
+		memset(&ev, 0, sizeof(ev));
+		ev.xclient.type = ClientMessage;
+		ev.xclient.window = bench.to[i];
+		ev.xclient.message_type = XInternAtom(bench.dpy, type, False);
+		ev.xclient.format = 32;
+		ev.xclient.data.l[0] = r->data[0];
+		ev.xclient.data.l[3] = r->data[3];
+		/* Atoms are interned again on this server. */
+		for (j = 1; j < 3; j++) {
+			atom = strtok_r(NULL, " ", &save);
+			if (r->data[j] != None && atom != NULL)
+				ev.xclient.data.l[j] = XInternAtom(bench.dpy, atom, False);
+		}
+		XSendEvent(bench.dpy, bench.root, False, SubstructureRedirectMask | SubstructureNotifyMask, &ev);
+		break;
+	case ConfigureRequest:
+		if (i < 0)
+			return;
+		wc.x = r->x;
+		wc.y = r->y;
+		wc.width = r->w;
+		wc.height = r->h;
+		XConfigureWindow(bench.dpy, bench.to[i], r->state & (CWX | CWY | CWWidth | CWHeight), &wc);
+		break;
+	case PropertyNotify:
+		if (r->window == 0)
+			XStoreName(bench.dpy, bench.root, name);
+		else if (i >= 0)
+			XStoreName(bench.dpy, bench.to[i], name);
+		break;
+	case MotionNotify:
+		XTestFakeMotionEvent(bench.dpy, -1, r->x, r->y, CurrentTime);
+		break;
+	case ButtonPress:
+	case ButtonRelease:
+		XTestFakeMotionEvent(bench.dpy, -1, r->x, r->y, CurrentTime);
+		XTestFakeButtonEvent(bench.dpy, r->detail, r->type == ButtonPress, CurrentTime);
+		break;
+	case KeyPress:
+	case KeyRelease:
+		/* barigui only gets its grabbed keys, not the modifiers. */
+		if (r->type == KeyPress && (r->state & Mod4Mask))
+			XTestFakeKeyEvent(bench.dpy, super, True, CurrentTime);
+		XTestFakeKeyEvent(bench.dpy, r->detail, r->type == KeyPress, CurrentTime);
+		if (r->type == KeyRelease && (r->state & Mod4Mask))
+			XTestFakeKeyEvent(bench.dpy, super, False, CurrentTime);
+		break;
+	}
+}
+
+void replay(const char *path, int fast)
+{
+	char magic[sizeof(RECORD_MAGIC) - 1], name[1024];
+	RecordEntry r;
+	struct timespec ts;
+	long long start, events = 0;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL)
+		die("can't open the log");
+	if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) || memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0)
+		die("not an event log");
+
+	start = now_us();
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		if (r.len >= sizeof(name) || fread(name, 1, r.len, f) != r.len)
+			die("truncated event log");
+		name[r.len] = '\0';
+
+		if (!fast && r.dt > 0) {
+			XFlush(bench.dpy);
+			/* usleep takes under a second only. */
+			ts.tv_sec = r.dt / 1000000;
+			ts.tv_nsec = r.dt % 1000000 * 1000;
+			nanosleep(&ts, NULL);
+		}
+		replay_entry(&r, name);
+		if (fast)
+			XSync(bench.dpy, False);
+		/* Our own clients' events aren't needed. */
+		while (XPending(bench.dpy))
+			XNextEvent(bench.dpy, &bench.ev);
+		events++;
+	}
+	fclose(f);
+
+	/* Let barigui catch up before asking for its stats. */
+	XSync(bench.dpy, False);
+	control("list\n", NULL, 0);
+	printf("{\"bench\":\"replay\",\"events\":%lld,\"fast\":%d,\"unit\":\"us\",\"elapsed\":%lld}\n",
+		events,
+		fast,
+		now_us() - start);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *display = ":99";
+	const char *log = NULL;
+	int opt, fast = 0;
+
+	bench.n = 50;
+	while ((opt = getopt(argc, argv, "n:d:r:f")) != -1) {
+		switch (opt) {
+		case 'n':
+			bench.n = atoi(optarg);
+			break;
+		case 'd':
+			display = optarg;
+			break;
+		case 'r':
+			log = optarg;
+			break;
+		case 'f':
+			fast = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || bench.n < 1 || bench.n > MAX_CLIENTS - 2)
+		goto usage;
+
+	start(display, argv[optind]);
+
+	if (log != NULL) {
+		replay(log, fast);
+		return bench_budgets() > 0;
+	}
+
+	bench_map();
+	bench_focus_click();
+	bench_relayout();
+	bench_drag();
+	bench_hidden_menu();
+	bench_status();
+
+	return bench_budgets() > 0;
+usage:
+	fprintf(stderr, "usage: barigui-bench [-n clients] [-d display] [-r log [-f]] path/to/barigui\n");
+	return 2;
+}
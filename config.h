@@ -1,3 +1,4 @@
+/* Fonts after the first are fallbacks, only opened when a glyph needs them. */
 static const char *font[] = { "Liberation Sans:size=12" };
 
 /* DRW colors, so hex strings. */
@@ -22,9 +23,74 @@ static const char *color_f[2] = { "#000000", "#9eeeee" };
 /* Pixels. You probably want just 1 as you have the title. */
 #define BORDER_WIDTH 1
 
+/* Milliseconds, the bar is never redrawn faster than this. */
+#define FRAME_INTERVAL 16
+/* Milliseconds to wait for a client to draw a size before resizing it again
+ * anyway (for clients doing _NET_WM_SYNC_REQUEST, others are resized at most
+ * once per FRAME_INTERVAL). */
+#define SYNC_TIMEOUT 100
+/* Milliseconds a control connection can stay quiet inside begin before the
+ * batch is committed for it, so a stuck script doesn't freeze layout. Its
+ * commit then fails. */
+#define BATCH_TIMEOUT 5000
+
+/* Pixels from a screen or floating window edge at which moved and resized
+ * windows stick to it. 0 disables snapping. */
+#define SNAP 8
+
+/* Uncomment to move and resize windows as an outline, configuring them once
+ * when the button is released. Smoother with heavy clients and over remote
+ * X, but nothing else is drawn during the drag. */
+/* #define OUTLINE_DRAG */
+
+/* FIFO in $XDG_RUNTIME_DIR (or /tmp) from which every line written replaces
+ * the status, without going through the X server. %s is the display. Comment
+ * out this def if you don't want it. */
+#define STATUS_FIFO "barigui-%s.status"
+
+/* Unix socket in $XDG_RUNTIME_DIR (or /tmp) to control barigui from scripts,
+ * %s being the display, so each server has its own. Comment out this def if
+ * you don't want it. */
+#define CONTROL_SOCKET "barigui-%s.sock"
+
+/* Built-in status, read directly from /proc and /sys every STATUS_INTERVAL
+ * milliseconds instead of using the root window name. 0 disables it (so you
+ * can use slstatus or similar). */
+#define STATUS_INTERVAL 0
+#define STATUS_SEPARATOR " | "
+
+/* Components without the resource (e.g. no battery) are just skipped. */
+static StatusItem status_items[] = {
+	/* function      argument */
+	{ status_network, "wlan0" },
+	{ status_load,    NULL },
+	{ status_memory,  NULL },
+	{ status_battery, "BAT0" },
+	{ status_clock,   "%a %d %b %H:%M" },
+};
+
+/* Most X round trips each operation should take (0 for no budget). The
+ * "stats" control command reports how often they're exceeded. */
+static const int round_trip_budget[OpLast] = {
+	/* Attributes, geometry, WM_NORMAL_HINTS, WM_NAME and _NET_WM_STATE.
+	 * smart_place adds none, see corebench's manage. */
+	[OpManage] = 5,
+	[OpUnmanage] = 1,
+	[OpFocus] = 1,
+	[OpHide] = 1,
+	[OpUnhide] = 1,
+	[OpDrag] = 1,
+	[OpStatus] = 2,
+	[OpWorkspace] = 1,
+};
+
 #define MODMASK (Mod4Mask)
 #define FULLSCREEN_KEY XK_f
 
+/* From 1 to 9, switched with MODMASK and the number keys or in the left bar.
+ * 1 hides the workspace buttons. */
+#define WORKSPACES 4
+
 static const char *menu[] = { "dmenu_run", NULL };
 static const char *volp[] = { "pamixer", "-i", "5", NULL };
 static const char *volm[] = { "pamixer", "-d", "5", NULL };
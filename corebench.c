@@ -0,0 +1,466 @@
+/* The whole of barigui, with its main out of the way. */
+#define main barigui_main
+#include "barigui.c"
+#undef main
+
+#include "mock.h"
+
+/*
+ * corebench.c - Microbenchmarks of barigui's management core.
+ *
+ * Runs barigui in-process on the mock display of mock.c, so there's no server
+ * and no scheduling noise: only the client lists, find_window, layout, focus
+ * and the hide/tile/workspace transitions are measured. Events are handed
+ * straight to handle_event. Every result is printed as a JSON object per line,
+ * with the requests and round trips each operation would have cost on a real
+ * server.
+ *
+ * Operations that relayout every client are run fewer times (-o) than the
+ * ones that touch a single client (-e).
+ *
+ * Usage: barigui-corebench [-n clients] [-e events] [-o operations]
+ */
+
+/*
+ * Copyright (C) 2024  Gabriel de Brito
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+typedef struct {
+	Wm wm;
+	Window *wins;
+	int n;
+	long events;
+	long ops;
+	unsigned long long seed;
+	char runtime[64];
+	/* Counters when the running benchmark started. */
+	unsigned long request;
+	unsigned long round_trips;
+	/* Round trips when the running sample started, and the most any
+	 * sample took. */
+	unsigned long sample_round_trips;
+	unsigned long max_round_trips;
+	Histogram h;
+	/* Some operation went over its round_trip_budget. */
+	int over_budget;
+} Core;
+
+static Core core;
+
+void cleanup(void)
+{
+	char path[256];
+
+	if (core.runtime[0] == '\0')
+		return;
+	if (core.wm.dpy != NULL) {
+#ifdef CONTROL_SOCKET
+		runtime_path(&core.wm, path, sizeof(path), CONTROL_SOCKET);
+		unlink(path);
+#endif
+#ifdef STATUS_FIFO
+		runtime_path(&core.wm, path, sizeof(path), STATUS_FIFO);
+		unlink(path);
+#endif
+	}
+	rmdir(core.runtime);
+}
+
+/* xorshift64, the same sequence every run. */
+int pick(void)
+{
+	core.seed ^= core.seed << 13;
+	core.seed ^= core.seed >> 7;
+	core.seed ^= core.seed << 17;
+	return core.seed % core.n;
+}
+
+Client *client(int i)
+{
+	return find_window(&core.wm, core.wins[i]).c;
+}
+
+void begin(void)
+{
+	memset(&core.h, 0, sizeof(core.h));
+	core.request = NextRequest(core.wm.dpy);
+	core.round_trips = mock_round_trips(core.wm.dpy);
+	core.max_round_trips = 0;
+}
+
+long long sample_begin(void)
+{
+	core.sample_round_trips = mock_round_trips(core.wm.dpy);
+	return now_ns();
+}
+
+void sample_end(long long t)
+{
+	unsigned long round_trips;
+
+	hist_record(&core.h, now_ns() - t);
+	round_trips = mock_round_trips(core.wm.dpy) - core.sample_round_trips;
+	if (round_trips > core.max_round_trips)
+		core.max_round_trips = round_trips;
+}
+
+/* budget is the most round trips a sample may take, as in
+ * round_trip_budget (0 for none). Going over it fails the run, so the
+ * budgets are checked without a server. */
+void report(const char *name, int budget)
+{
+	Histogram *h = &core.h;
+
+	printf("{\"bench\":\"%s\",\"clients\":%d,\"unit\":\"ns\",\"samples\":%llu", name, core.n, h->count);
+	if (h->count > 0) {
+		printf(",\"mean\":%llu,\"p50\":%llu,\"p99\":%llu,\"max\":%llu,\"requests\":%.1f,\"round_trips\":%.1f",
+			h->sum / h->count,
+			hist_quantile(h, 0.5),
+			hist_quantile(h, 0.99),
+			h->max,
+			(double) (NextRequest(core.wm.dpy) - core.request) / h->count,
+			(double) (mock_round_trips(core.wm.dpy) - core.round_trips) / h->count);
+		printf(",\"max_round_trips\":%lu", core.max_round_trips);
+	}
+	if (budget > 0) {
+		printf(",\"budget\":%d", budget);
+		if (core.max_round_trips > budget) {
+			printf(",\"over_budget\":true");
+			core.over_budget = 1;
+		}
+	}
+	printf("}\n");
+	fflush(stdout);
+}
+
+void run(XEvent *ev)
+{
+	long long t = sample_begin();
+
+	handle_event(&core.wm, ev);
+	sample_end(t);
+}
+
+void bench_manage(void)
+{
+	XEvent ev;
+	char name[32];
+	int i;
+
+	begin();
+	for (i = 0; i < core.n; i++) {
+		snprintf(name, sizeof(name), "client %d", i);
+		core.wins[i] = mock_create_window(core.wm.dpy, (i * 8) % 800, 40 + (i * 2) % 300, 200, 100, name);
+		/* Every fourth goes through smart_place. */
+		if (i % 4 == 3)
+			mock_unposition(core.wm.dpy, core.wins[i]);
+		memset(&ev, 0, sizeof(ev));
+		ev.type = MapRequest;
+		ev.xmaprequest.parent = core.wm.root;
+		ev.xmaprequest.window = core.wins[i];
+		run(&ev);
+	}
+	report("manage", round_trip_budget[OpManage]);
+}
+
+/* Names are fetched once per frame, taken here as every 64 events. The
+ * event that ends a frame is timed with the fetches. With one_client a single
+ * client retitles itself as fast as it can, otherwise random ones do. */
+void bench_property(const char *name, int one_client)
+{
+	XEvent ev;
+	long long t;
+	long i;
+
+	begin();
+	for (i = 0; i < core.events; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.type = PropertyNotify;
+		ev.xproperty.window = core.wins[one_client ? 0 : pick()];
+		ev.xproperty.atom = XA_WM_NAME;
+		ev.xproperty.state = PropertyNewValue;
+		t = sample_begin();
+		handle_event(&core.wm, &ev);
+		if (i % 64 == 63)
+			flush_properties(&core.wm);
+		sample_end(t);
+	}
+	flush_properties(&core.wm);
+	report(name, 0);
+}
+
+void bench_configure(void)
+{
+	XEvent ev;
+	long i;
+
+	begin();
+	for (i = 0; i < core.events; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.type = ConfigureRequest;
+		ev.xconfigurerequest.window = core.wins[pick()];
+		ev.xconfigurerequest.value_mask = CWX | CWY | CWWidth | CWHeight;
+		ev.xconfigurerequest.x = i % 800;
+		ev.xconfigurerequest.y = 40 + i % 300;
+		ev.xconfigurerequest.width = 100 + i % 200;
+		ev.xconfigurerequest.height = 100 + i % 100;
+		run(&ev);
+	}
+	report("configure_request", 0);
+}
+
+/* A status redraw from submission until it's on the bar, through the
+ * renderer thread and apply_renders. */
+void bench_render(void)
+{
+	char status[32];
+	long long t;
+	long i;
+
+	begin();
+	for (i = 0; i < core.ops; i++) {
+		snprintf(status, sizeof(status), "render %ld", i);
+		strcpy(core.wm.status, status);
+		t = sample_begin();
+		render_right_bar(&core.wm);
+		wait_render(&core.wm, &core.wm.right_bar);
+		sample_end(t);
+	}
+	report("render_bar", 0);
+}
+
+/* Run before and after bench_tile, as tiled clients must not make focus
+ * changes cost more requests. */
+void bench_focus(const char *name)
+{
+	XEvent ev;
+	long i;
+
+	begin();
+	for (i = 0; i < core.ops; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.type = ButtonPress;
+		ev.xbutton.window = core.wins[pick()];
+		ev.xbutton.button = Button1;
+		run(&ev);
+	}
+	report(name, round_trip_budget[OpFocus]);
+}
+
+/* Dragging a frame around all the others, as move_client does. */
+void bench_snap(void)
+{
+	long long t;
+	long i;
+	int x, y;
+
+	build_index(&core.wm, NULL);
+	begin();
+	for (i = 0; i < core.events; i++) {
+		x = (i * 7) % core.wm.sw;
+		y = (i * 13) % core.wm.sh;
+		t = sample_begin();
+		snap_move(&core.wm, &x, &y, 200, 100);
+		sample_end(t);
+	}
+	report("snap_move", 0);
+}
+
+/* Where a new client without a position would go. */
+void bench_place(void)
+{
+	Client c;
+	long long t;
+	long i;
+
+	begin();
+	for (i = 0; i < core.ops; i++) {
+		c.req_w = 100 + i % 200;
+		c.req_h = 100 + i % 100;
+		t = sample_begin();
+		smart_place(&core.wm, &c);
+		sample_end(t);
+	}
+	report("smart_place", 0);
+}
+
+/* Status updates arriving while a window is dragged with the server grabbed
+ * (as OUTLINE_DRAG does). Redraws must pile up as a single pending job and
+ * never block the drag, and go out after the ungrab. */
+void bench_drag_status(void)
+{
+	Client *c = client(0);
+	char status[32];
+	long long t;
+	long i;
+
+	begin();
+	core.wm.server_grabbed = 1;
+	for (i = 0; i < core.events; i++) {
+		snprintf(status, sizeof(status), "drag %ld", i);
+		t = sample_begin();
+		drag_client(&core.wm, c, i % 800, 40 + i % 300, c->w, c->h);
+		set_status(&core.wm, status);
+		draw_status(&core.wm);
+		sample_end(t);
+	}
+	core.wm.server_grabbed = 0;
+	submit_renders(&core.wm);
+	wait_render(&core.wm, &core.wm.right_bar);
+	report("drag_status", round_trip_budget[OpDrag]);
+}
+
+/* Half of the clients end up tiled, which the remaining benchmarks keep. */
+void bench_tile(void)
+{
+	long long t;
+	Client *c;
+	long i;
+
+	begin();
+	for (i = 0; i < core.ops; i++) {
+		c = client(pick());
+		t = sample_begin();
+		toggle_tile(&core.wm, c);
+		sample_end(t);
+	}
+	report("toggle_tile", 0);
+}
+
+void bench_hide(void)
+{
+	long long t;
+	Client *c;
+	long i;
+
+	begin();
+	for (i = 0; i < core.ops; i++) {
+		c = client(pick());
+		t = sample_begin();
+		hide_client(&core.wm, c);
+		unhide_client(&core.wm, c);
+		sample_end(t);
+	}
+	report("hide_unhide", round_trip_budget[OpHide] + round_trip_budget[OpUnhide]);
+}
+
+/* Half of the clients go to the second workspace, then the screen flips
+ * between the two. Every switch unmaps and maps n / 2 frames. */
+void bench_workspace(void)
+{
+	Workspace *ws = core.wm.workspaces;
+	long long t;
+	long i;
+
+	if (WORKSPACES < 2)
+		return;
+	for (i = 0; i < core.n; i += 2)
+		send_client(&core.wm, client(i), &ws[1]);
+
+	begin();
+	for (i = 0; i < core.ops; i++) {
+		t = sample_begin();
+		view_workspace(&core.wm, &ws[(i + 1) % 2]);
+		sample_end(t);
+	}
+	report("workspace_switch", round_trip_budget[OpWorkspace]);
+	view_workspace(&core.wm, &ws[0]);
+}
+
+void bench_unmanage(void)
+{
+	XEvent ev;
+	int i;
+
+	begin();
+	for (i = 0; i < core.n; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.type = DestroyNotify;
+		ev.xdestroywindow.event = core.wm.root;
+		ev.xdestroywindow.window = core.wins[i];
+		run(&ev);
+	}
+	report("unmanage", round_trip_budget[OpUnmanage]);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	core.n = 10000;
+	core.events = 1000000;
+	core.ops = 1000;
+	core.seed = 88172645463325252ULL;
+	while ((opt = getopt(argc, argv, "n:e:o:")) != -1) {
+		switch (opt) {
+		case 'n':
+			core.n = atoi(optarg);
+			break;
+		case 'e':
+			core.events = atol(optarg);
+			break;
+		case 'o':
+			core.ops = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: barigui-corebench [-n clients] [-e events] [-o operations]\n");
+			return 1;
+		}
+	}
+	if (core.n < 1)
+		core.n = 1;
+	core.wins = calloc(core.n, sizeof(Window));
+	assert(core.wins != NULL && "Buy more ram lol");
+
+	/* Keep the status FIFO and control socket away from a running
+	 * barigui. */
+	strcpy(core.runtime, "/tmp/barigui-corebench.XXXXXX");
+	if (mkdtemp(core.runtime) == NULL)
+		return 1;
+	setenv("XDG_RUNTIME_DIR", core.runtime, 1);
+	atexit(cleanup);
+
+	XInitThreads();
+	core.wm.started = now_ns();
+	if (!(core.wm.dpy = XOpenDisplay(NULL)))
+		return 1;
+	setup(&core.wm);
+
+	bench_manage();
+	bench_property("property_notify", 0);
+	bench_property("title_storm", 1);
+	bench_configure();
+	bench_render();
+	bench_focus("focus_click");
+	bench_snap();
+	bench_place();
+	bench_drag_status();
+	bench_tile();
+	bench_focus("focus_tiled");
+	bench_hide();
+	bench_workspace();
+	bench_unmanage();
+
+	if (core.over_budget) {
+		fprintf(stderr, "barigui-corebench: over the round trip budget\n");
+		return 1;
+	}
+	return 0;
+}
@@ -73,8 +73,10 @@ typedef struct {
 typedef struct Fnt {
 	Display *dpy;
 	unsigned int h;
+	/* NULL for fallbacks not needed yet, see xfont_load. */
 	XftFont *xfont;
 	FcPattern *pattern;
+	const char *name;
 	struct Fnt *next;
 } Fnt;
 
@@ -275,6 +277,8 @@ xfont_create(Drw *drw, const char *fontname, FcPattern *fontpattern)
 	font->pattern = pattern;
 	font->h = xfont->ascent + xfont->descent;
 	font->dpy = drw->dpy;
+	font->name = fontname;
+	font->next = NULL;
 
 	return font;
 }
@@ -286,24 +290,55 @@ xfont_free(Fnt *font)
 		return;
 	if (font->pattern)
 		FcPatternDestroy(font->pattern);
-	XftFontClose(font->dpy, font->xfont);
+	if (font->xfont)
+		XftFontClose(font->dpy, font->xfont);
 	free(font);
 }
 
+/* Opens a fallback font of a set the first time a glyph isn't in the fonts
+ * before it. A font that can't be opened loses its name, so it's tried only
+ * once. Returns 0 if the font isn't usable. */
+static int
+xfont_load(Drw *drw, Fnt *font)
+{
+	Fnt *loaded;
+
+	if (font->xfont)
+		return 1;
+	if (!font->name || !(loaded = xfont_create(drw, font->name, NULL))) {
+		font->name = NULL;
+		return 0;
+	}
+	font->xfont = loaded->xfont;
+	font->pattern = loaded->pattern;
+	font->h = loaded->h;
+	free(loaded);
+	return 1;
+}
+
+/* Only the first font that loads is opened now, the ones after it are
+ * fallbacks opened by drw_text when needed. */
 Fnt *
 drw_fontset_create(Drw* drw, const char *fonts[], size_t fontcount)
 {
-	Fnt *cur, *ret = NULL;
+	Fnt *cur, *ret = NULL, **last = &ret;
 	size_t i;
 
 	if (!drw || !fonts)
 		return NULL;
 
-	for (i = 1; i <= fontcount; i++) {
-		if ((cur = xfont_create(drw, fonts[fontcount - i], NULL))) {
-			cur->next = ret;
-			ret = cur;
+	for (i = 0; i < fontcount; i++) {
+		if (ret) {
+			if (!(cur = calloc(1, sizeof(Fnt))))
+				break;
+			cur->dpy = drw->dpy;
+			cur->name = fonts[i];
+		} else if (!(cur = xfont_create(drw, fonts[i], NULL))) {
+			continue;
 		}
+		cur->next = NULL;
+		*last = cur;
+		last = &cur->next;
 	}
 	return (drw->fonts = ret);
 }
@@ -412,6 +447,8 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lp
 		while (*text) {
 			utf8charlen = utf8decode(text, &utf8codepoint, UTF_SIZ);
 			for (curfont = drw->fonts; curfont; curfont = curfont->next) {
+				if (!xfont_load(drw, curfont))
+					continue;
 				charexists = charexists || XftCharExists(drw->dpy, curfont->xfont, utf8codepoint);
 				if (charexists) {
 					if (curfont == usedfont) {
@@ -0,0 +1,854 @@
+#define _GNU_SOURCE
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/Xft/Xft.h>
+#include <X11/extensions/sync.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "mock.h"
+
+/*
+ * mock.c - In-memory Xlib, Xft and fontconfig for barigui (see mock.h).
+ *
+ * Only what barigui and drw.h call is here, and only as far as they look at
+ * the results: windows keep their geometry, map state and name, everything
+ * else is accepted and dropped. There's a single screen, shared by every
+ * display opened. Only requests (counted per display) and resource ids are
+ * safe to use from other threads, which is all barigui's renderer needs.
+ */
+
+/*
+ * Copyright (C) 2024  Gabriel de Brito
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define MOCK_W 1280
+#define MOCK_H 800
+/* Character cell of the fake font. */
+#define MOCK_CHAR_W 7
+#define MOCK_ASCENT 11
+#define MOCK_DESCENT 3
+
+/* Every request goes through here so NextRequest counts them. */
+#define REQUEST(dpy) (((_XPrivDisplay) (dpy))->request++)
+#define ROUND_TRIP(dpy) (REQUEST(dpy), ((MockDisplay *) (dpy))->round_trips++)
+
+/* A display, with what Xlib would keep per connection. */
+typedef struct {
+	__typeof__(*(_XPrivDisplay) 0) dpy;
+	unsigned long round_trips;
+} MockDisplay;
+
+typedef struct {
+	int x;
+	int y;
+	unsigned int w;
+	unsigned int h;
+	unsigned int border;
+	int mapped;
+	int destroyed;
+	/* Has PPosition in its WM_NORMAL_HINTS. */
+	int positioned;
+	char *name;
+} MockWindow;
+
+typedef struct {
+	/* Window ids are indexes here plus one, the root is 1. */
+	MockWindow *windows;
+	size_t n_windows;
+	size_t cap_windows;
+	/* Pixmaps, GCs, cursors. Never looked at again. Taken atomically. */
+	XID next_resource;
+	/* Ring of pushed events. */
+	XEvent *events;
+	size_t head;
+	size_t len;
+	size_t cap_events;
+	XErrorHandler error_handler;
+	Screen screen;
+	Visual visual;
+} Mock;
+
+static Mock mock;
+/* Stands for every GC and fontconfig object, which are opaque. */
+static char dummy;
+
+static MockWindow *window(Window win)
+{
+	if (win == 0 || win > mock.n_windows)
+		return NULL;
+	if (mock.windows[win - 1].destroyed)
+		return NULL;
+	return &mock.windows[win - 1];
+}
+
+static Window new_window(int x, int y, unsigned int w, unsigned int h, unsigned int border)
+{
+	MockWindow *win;
+
+	if (mock.n_windows == mock.cap_windows) {
+		mock.cap_windows = mock.cap_windows ? mock.cap_windows * 2 : 1024;
+		mock.windows = realloc(mock.windows, mock.cap_windows * sizeof(MockWindow));
+		assert(mock.windows != NULL && "Buy more ram lol");
+	}
+	win = &mock.windows[mock.n_windows++];
+	memset(win, 0, sizeof(*win));
+	win->x = x;
+	win->y = y;
+	win->w = w;
+	win->h = h;
+	win->border = border;
+	return mock.n_windows;
+}
+
+Window mock_create_window(Display *dpy, int x, int y, unsigned int w, unsigned int h, const char *name)
+{
+	Window win = new_window(x, y, w, h, 0);
+
+	window(win)->positioned = 1;
+	mock_set_name(dpy, win, name);
+	return win;
+}
+
+void mock_unposition(Display *dpy, Window win)
+{
+	MockWindow *w = window(win);
+
+	if (w != NULL)
+		w->positioned = 0;
+}
+
+void mock_set_name(Display *dpy, Window win, const char *name)
+{
+	MockWindow *w = window(win);
+
+	if (w == NULL)
+		return;
+	free(w->name);
+	w->name = name != NULL ? strdup(name) : NULL;
+}
+
+void mock_push(Display *dpy, XEvent *ev)
+{
+	size_t i, n;
+	XEvent *events;
+
+	if (mock.len == mock.cap_events) {
+		n = mock.cap_events ? mock.cap_events * 2 : 1024;
+		events = malloc(n * sizeof(XEvent));
+		assert(events != NULL && "Buy more ram lol");
+		for (i = 0; i < mock.len; i++)
+			events[i] = mock.events[(mock.head + i) % mock.cap_events];
+		free(mock.events);
+		mock.events = events;
+		mock.cap_events = n;
+		mock.head = 0;
+	}
+	ev->xany.display = dpy;
+	mock.events[(mock.head + mock.len) % mock.cap_events] = *ev;
+	mock.len++;
+}
+
+unsigned long mock_round_trips(Display *dpy)
+{
+	return ((MockDisplay *) dpy)->round_trips;
+}
+
+/* Xlib. */
+
+Status XInitThreads(void)
+{
+	return True;
+}
+
+Display *XOpenDisplay(const char *name)
+{
+	MockDisplay *m = calloc(1, sizeof(MockDisplay));
+	_XPrivDisplay dpy;
+
+	if (m == NULL)
+		return NULL;
+	dpy = &m->dpy;
+	/* Never readable, events are checked with XPending first. */
+	dpy->fd = eventfd(0, EFD_CLOEXEC);
+	dpy->nscreens = 1;
+	dpy->default_screen = 0;
+	dpy->display_name = "mock";
+	dpy->screens = &mock.screen;
+	if (mock.screen.display != NULL)
+		return (Display *) dpy;
+	mock.screen.display = (Display *) dpy;
+	mock.screen.root = new_window(0, 0, MOCK_W, MOCK_H, 0);
+	mock.screen.width = MOCK_W;
+	mock.screen.height = MOCK_H;
+	mock.screen.root_depth = 24;
+	mock.screen.root_visual = &mock.visual;
+	mock.screen.cmap = 1;
+	mock.next_resource = 1 << 24;
+	return (Display *) dpy;
+}
+
+int XCloseDisplay(Display *dpy)
+{
+	close(((_XPrivDisplay) dpy)->fd);
+	free(dpy);
+	return 0;
+}
+
+int XPending(Display *dpy)
+{
+	return mock.len;
+}
+
+int XNextEvent(Display *dpy, XEvent *ev)
+{
+	/* Nothing would ever come. */
+	assert(mock.len > 0 && "XNextEvent on an empty mock queue");
+	*ev = mock.events[mock.head];
+	mock.head = (mock.head + 1) % mock.cap_events;
+	mock.len--;
+	return 0;
+}
+
+int XSync(Display *dpy, Bool discard)
+{
+	ROUND_TRIP(dpy);
+	return 1;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler)
+{
+	XErrorHandler old = mock.error_handler;
+
+	mock.error_handler = handler;
+	return old;
+}
+
+int XFree(void *data)
+{
+	free(data);
+	return 1;
+}
+
+Window XCreateSimpleWindow(Display *dpy, Window parent, int x, int y, unsigned int w, unsigned int h, unsigned int border, unsigned long border_pixel, unsigned long background)
+{
+	REQUEST(dpy);
+	return new_window(x, y, w, h, border);
+}
+
+Window XCreateWindow(Display *dpy, Window parent, int x, int y, unsigned int w, unsigned int h, unsigned int border, int depth, unsigned int class, Visual *visual, unsigned long mask, XSetWindowAttributes *attributes)
+{
+	REQUEST(dpy);
+	return new_window(x, y, w, h, border);
+}
+
+int XDestroyWindow(Display *dpy, Window win)
+{
+	MockWindow *w = window(win);
+
+	REQUEST(dpy);
+	if (w != NULL) {
+		free(w->name);
+		w->name = NULL;
+		w->destroyed = 1;
+	}
+	return 1;
+}
+
+int XMapWindow(Display *dpy, Window win)
+{
+	MockWindow *w = window(win);
+
+	REQUEST(dpy);
+	if (w != NULL)
+		w->mapped = 1;
+	return 1;
+}
+
+int XMapSubwindows(Display *dpy, Window win)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XMapRaised(Display *dpy, Window win)
+{
+	return XMapWindow(dpy, win);
+}
+
+int XUnmapWindow(Display *dpy, Window win)
+{
+	MockWindow *w = window(win);
+
+	REQUEST(dpy);
+	if (w != NULL)
+		w->mapped = 0;
+	return 1;
+}
+
+int XMoveResizeWindow(Display *dpy, Window win, int x, int y, unsigned int width, unsigned int height)
+{
+	MockWindow *w = window(win);
+
+	REQUEST(dpy);
+	if (w != NULL) {
+		w->x = x;
+		w->y = y;
+		w->w = width;
+		w->h = height;
+	}
+	return 1;
+}
+
+int XMoveWindow(Display *dpy, Window win, int x, int y)
+{
+	MockWindow *w = window(win);
+
+	REQUEST(dpy);
+	if (w != NULL) {
+		w->x = x;
+		w->y = y;
+	}
+	return 1;
+}
+
+int XResizeWindow(Display *dpy, Window win, unsigned int width, unsigned int height)
+{
+	MockWindow *w = window(win);
+
+	REQUEST(dpy);
+	if (w != NULL) {
+		w->w = width;
+		w->h = height;
+	}
+	return 1;
+}
+
+int XSetWindowBorderWidth(Display *dpy, Window win, unsigned int width)
+{
+	MockWindow *w = window(win);
+
+	REQUEST(dpy);
+	if (w != NULL)
+		w->border = width;
+	return 1;
+}
+
+Status XGetGeometry(Display *dpy, Drawable d, Window *root, int *x, int *y, unsigned int *width, unsigned int *height, unsigned int *border, unsigned int *depth)
+{
+	MockWindow *w = window(d);
+
+	ROUND_TRIP(dpy);
+	if (w == NULL)
+		return 0;
+	*root = mock.screen.root;
+	*x = w->x;
+	*y = w->y;
+	*width = w->w;
+	*height = w->h;
+	*border = w->border;
+	*depth = mock.screen.root_depth;
+	return 1;
+}
+
+Status XGetWindowAttributes(Display *dpy, Window win, XWindowAttributes *wa)
+{
+	MockWindow *w = window(win);
+
+	ROUND_TRIP(dpy);
+	if (w == NULL)
+		return 0;
+	memset(wa, 0, sizeof(*wa));
+	wa->x = w->x;
+	wa->y = w->y;
+	wa->width = w->w;
+	wa->height = w->h;
+	wa->border_width = w->border;
+	wa->depth = mock.screen.root_depth;
+	wa->visual = &mock.visual;
+	wa->root = mock.screen.root;
+	wa->map_state = w->mapped ? IsViewable : IsUnmapped;
+	wa->screen = &mock.screen;
+	return 1;
+}
+
+Status XGetWMName(Display *dpy, Window win, XTextProperty *prop)
+{
+	MockWindow *w = window(win);
+
+	ROUND_TRIP(dpy);
+	if (w == NULL || w->name == NULL)
+		return 0;
+	prop->value = (unsigned char *) strdup(w->name);
+	prop->encoding = XA_STRING;
+	prop->format = 8;
+	prop->nitems = strlen(w->name);
+	return 1;
+}
+
+int XReparentWindow(Display *dpy, Window win, Window parent, int x, int y)
+{
+	MockWindow *w = window(win);
+
+	REQUEST(dpy);
+	if (w != NULL) {
+		w->x = x;
+		w->y = y;
+	}
+	return 1;
+}
+
+int XStoreName(Display *dpy, Window win, const char *name)
+{
+	REQUEST(dpy);
+	mock_set_name(dpy, win, name);
+	return 1;
+}
+
+/* Atoms are just numbered, past the predefined ones. */
+Status XInternAtoms(Display *dpy, char **names, int count, Bool only_if_exists, Atom *atoms)
+{
+	int i;
+
+	ROUND_TRIP(dpy);
+	for (i = 0; i < count; i++)
+		atoms[i] = XA_LAST_PREDEFINED + 1 + i;
+	return 1;
+}
+
+/* Only for recording, which corebench doesn't do. */
+char *XGetAtomName(Display *dpy, Atom atom)
+{
+	ROUND_TRIP(dpy);
+	return NULL;
+}
+
+/* Windows have no other properties. */
+
+Status XGetWMProtocols(Display *dpy, Window win, Atom **protocols, int *count)
+{
+	ROUND_TRIP(dpy);
+	return 0;
+}
+
+/* Only sizes and, unless mock_unposition was called, positions. */
+Status XGetWMNormalHints(Display *dpy, Window win, XSizeHints *hints, long *supplied)
+{
+	MockWindow *w = window(win);
+
+	ROUND_TRIP(dpy);
+	memset(hints, 0, sizeof(*hints));
+	hints->flags = PSize | (w != NULL && w->positioned ? PPosition : 0);
+	*supplied = PAllHints;
+	return 1;
+}
+
+int XGetWindowProperty(Display *dpy, Window win, Atom property, long offset, long length, Bool delete, Atom type, Atom *actual_type, int *actual_format, unsigned long *items, unsigned long *after, unsigned char **data)
+{
+	ROUND_TRIP(dpy);
+	*actual_type = None;
+	*actual_format = 0;
+	*items = 0;
+	*after = 0;
+	*data = NULL;
+	return Success;
+}
+
+/* Requests whose effect nothing reads back. */
+
+int XSelectInput(Display *dpy, Window win, long mask)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XGrabServer(Display *dpy)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XUngrabServer(Display *dpy)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XAddToSaveSet(Display *dpy, Window win)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XRemoveFromSaveSet(Display *dpy, Window win)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+Status XSendEvent(Display *dpy, Window win, Bool propagate, long mask, XEvent *ev)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XChangeProperty(Display *dpy, Window win, Atom property, Atom type, int format, int mode, const unsigned char *data, int n)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XDeleteProperty(Display *dpy, Window win, Atom property)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XRaiseWindow(Display *dpy, Window win)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XLowerWindow(Display *dpy, Window win)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XSetWindowBorder(Display *dpy, Window win, unsigned long pixel)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XChangeWindowAttributes(Display *dpy, Window win, unsigned long mask, XSetWindowAttributes *attributes)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XSetWindowBackground(Display *dpy, Window win, unsigned long pixel)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XSetWindowBackgroundPixmap(Display *dpy, Window win, Pixmap pixmap)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XClearWindow(Display *dpy, Window win)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XSetInputFocus(Display *dpy, Window win, int revert, Time time)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XKillClient(Display *dpy, XID resource)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XDefineCursor(Display *dpy, Window win, Cursor cursor)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+Cursor XCreateFontCursor(Display *dpy, unsigned int shape)
+{
+	REQUEST(dpy);
+	return __atomic_fetch_add(&mock.next_resource, 1, __ATOMIC_RELAXED);
+}
+
+int XFreeCursor(Display *dpy, Cursor cursor)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XGrabButton(Display *dpy, unsigned int button, unsigned int modifiers, Window win, Bool owner_events, unsigned int mask, int pointer_mode, int keyboard_mode, Window confine_to, Cursor cursor)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XUngrabButton(Display *dpy, unsigned int button, unsigned int modifiers, Window win)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XGrabKey(Display *dpy, int keycode, unsigned int modifiers, Window win, Bool owner_events, int pointer_mode, int keyboard_mode)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+KeyCode XKeysymToKeycode(Display *dpy, KeySym keysym)
+{
+	return keysym & 0xff;
+}
+
+int XGrabPointer(Display *dpy, Window win, Bool owner_events, unsigned int mask, int pointer_mode, int keyboard_mode, Window confine_to, Cursor cursor, Time time)
+{
+	ROUND_TRIP(dpy);
+	return GrabSuccess;
+}
+
+int XUngrabPointer(Display *dpy, Time time)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+Pixmap XCreatePixmap(Display *dpy, Drawable d, unsigned int w, unsigned int h, unsigned int depth)
+{
+	REQUEST(dpy);
+	return __atomic_fetch_add(&mock.next_resource, 1, __ATOMIC_RELAXED);
+}
+
+int XFreePixmap(Display *dpy, Pixmap pixmap)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+GC XCreateGC(Display *dpy, Drawable d, unsigned long mask, XGCValues *values)
+{
+	REQUEST(dpy);
+	return (GC) &dummy;
+}
+
+int XFreeGC(Display *dpy, GC gc)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XSetForeground(Display *dpy, GC gc, unsigned long pixel)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XSetLineAttributes(Display *dpy, GC gc, unsigned int width, int line_style, int cap_style, int join_style)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XFillRectangle(Display *dpy, Drawable d, GC gc, int x, int y, unsigned int w, unsigned int h)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XDrawRectangle(Display *dpy, Drawable d, GC gc, int x, int y, unsigned int w, unsigned int h)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+int XCopyArea(Display *dpy, Drawable src, Drawable dst, GC gc, int src_x, int src_y, unsigned int w, unsigned int h, int dst_x, int dst_y)
+{
+	REQUEST(dpy);
+	return 1;
+}
+
+/* No sync extension, so none of the rest is ever called. */
+
+Status XSyncQueryExtension(Display *dpy, int *event_base, int *error_base)
+{
+	return False;
+}
+
+Status XSyncInitialize(Display *dpy, int *major, int *minor)
+{
+	return False;
+}
+
+Status XSyncQueryCounter(Display *dpy, XSyncCounter counter, XSyncValue *value)
+{
+	ROUND_TRIP(dpy);
+	return False;
+}
+
+XSyncAlarm XSyncCreateAlarm(Display *dpy, unsigned long mask, XSyncAlarmAttributes *attributes)
+{
+	REQUEST(dpy);
+	return __atomic_fetch_add(&mock.next_resource, 1, __ATOMIC_RELAXED);
+}
+
+Status XSyncChangeAlarm(Display *dpy, XSyncAlarm alarm, unsigned long mask, XSyncAlarmAttributes *attributes)
+{
+	REQUEST(dpy);
+	return True;
+}
+
+Status XSyncDestroyAlarm(Display *dpy, XSyncAlarm alarm)
+{
+	REQUEST(dpy);
+	return True;
+}
+
+void XSyncIntsToValue(XSyncValue *value, unsigned int lo, int hi)
+{
+	value->lo = lo;
+	value->hi = hi;
+}
+
+/* Xft, with a fixed cell font that has every character. */
+
+XftFont *XftFontOpenName(Display *dpy, int screen, const char *name)
+{
+	XftFont *f = calloc(1, sizeof(XftFont));
+
+	if (f == NULL)
+		return NULL;
+	f->ascent = MOCK_ASCENT;
+	f->descent = MOCK_DESCENT;
+	f->height = MOCK_ASCENT + MOCK_DESCENT;
+	f->max_advance_width = MOCK_CHAR_W;
+	f->pattern = (FcPattern *) &dummy;
+	return f;
+}
+
+XftFont *XftFontOpenPattern(Display *dpy, FcPattern *pattern)
+{
+	return XftFontOpenName(dpy, 0, NULL);
+}
+
+FcPattern *XftFontMatch(Display *dpy, int screen, const FcPattern *pattern, FcResult *result)
+{
+	*result = FcResultMatch;
+	return (FcPattern *) &dummy;
+}
+
+void XftFontClose(Display *dpy, XftFont *font)
+{
+	free(font);
+}
+
+FcBool XftCharExists(Display *dpy, XftFont *font, FcChar32 ucs4)
+{
+	return FcTrue;
+}
+
+void XftTextExtentsUtf8(Display *dpy, XftFont *font, const FcChar8 *string, int len, XGlyphInfo *extents)
+{
+	memset(extents, 0, sizeof(*extents));
+	extents->width = len * MOCK_CHAR_W;
+	extents->height = font->height;
+	extents->xOff = len * MOCK_CHAR_W;
+}
+
+/* XftDraws only remember their display, for the requests. */
+XftDraw *XftDrawCreate(Display *dpy, Drawable drawable, Visual *visual, Colormap colormap)
+{
+	Display **draw = malloc(sizeof(Display *));
+
+	assert(draw != NULL && "Buy more ram lol");
+	*draw = dpy;
+	return (XftDraw *) draw;
+}
+
+void XftDrawDestroy(XftDraw *draw)
+{
+	free(draw);
+}
+
+void XftDrawStringUtf8(XftDraw *draw, const XftColor *color, XftFont *font, int x, int y, const FcChar8 *string, int len)
+{
+	REQUEST(*(Display **) draw);
+}
+
+Bool XftColorAllocName(Display *dpy, const Visual *visual, Colormap cmap, const char *name, XftColor *result)
+{
+	memset(result, 0, sizeof(*result));
+	return True;
+}
+
+/* fontconfig. */
+
+FcPattern *FcNameParse(const FcChar8 *name)
+{
+	return (FcPattern *) &dummy;
+}
+
+FcPattern *FcPatternDuplicate(const FcPattern *p)
+{
+	return (FcPattern *) &dummy;
+}
+
+void FcPatternDestroy(FcPattern *p)
+{
+}
+
+FcResult FcPatternGetBool(const FcPattern *p, const char *object, int id, FcBool *b)
+{
+	return FcResultNoMatch;
+}
+
+FcBool FcPatternAddBool(FcPattern *p, const char *object, FcBool b)
+{
+	return FcTrue;
+}
+
+FcBool FcPatternAddCharSet(FcPattern *p, const char *object, const FcCharSet *c)
+{
+	return FcTrue;
+}
+
+FcCharSet *FcCharSetCreate(void)
+{
+	return (FcCharSet *) &dummy;
+}
+
+FcBool FcCharSetAddChar(FcCharSet *fcs, FcChar32 ucs4)
+{
+	return FcTrue;
+}
+
+void FcCharSetDestroy(FcCharSet *fcs)
+{
+}
+
+FcBool FcConfigSubstitute(FcConfig *config, FcPattern *p, FcMatchKind kind)
+{
+	return FcTrue;
+}
+
+void FcDefaultSubstitute(FcPattern *pattern)
+{
+}
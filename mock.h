@@ -0,0 +1,49 @@
+#ifndef __MOCK_INCLUDED
+#define __MOCK_INCLUDED
+
+/*
+ * mock.h - In-memory display for exercising barigui without an X server.
+ *
+ * barigui only talks to the display through Xlib, Xft and fontconfig. mock.c
+ * implements the subset of them it uses, so linking against it instead of the
+ * real libraries gives a display where requests cost nothing, nothing is drawn
+ * and events only come from mock_push. Requests are still counted in
+ * NextRequest, so X traffic accounting works as usual.
+ */
+
+/*
+ * Copyright (C) 2024  Gabriel de Brito
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <X11/Xlib.h>
+
+/* Creates a top-level window like a client would. name may be NULL. */
+Window mock_create_window(Display *dpy, int x, int y, unsigned int w, unsigned int h, const char *name);
+/* Windows are created asking for their position (PPosition), this makes the
+ * window manager choose it instead. */
+void mock_unposition(Display *dpy, Window win);
+/* Sets the WM_NAME of a window, without generating events. */
+void mock_set_name(Display *dpy, Window win, const char *name);
+/* Queues an event for XNextEvent. */
+void mock_push(Display *dpy, XEvent *ev);
+/* Round trips made so far (calls waiting for a reply). */
+unsigned long mock_round_trips(Display *dpy);
+
+#endif /* __MOCK_INCLUDED */
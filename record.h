@@ -0,0 +1,67 @@
+#ifndef __RECORD_INCLUDED
+#define __RECORD_INCLUDED
+
+/*
+ * record.h - Format of barigui's event logs.
+ *
+ * A log is RECORD_MAGIC followed by one RecordEntry per event, each followed
+ * by len bytes of text (a window name, or for client messages the names of
+ * the message type and of the atoms in data[1] and data[2], separated by
+ * spaces; not NUL-terminated). Everything is in
+ * host byte order, logs are meant to be replayed on the same machine they were
+ * recorded or one alike.
+ */
+
+/*
+ * Copyright (C) 2024  Gabriel de Brito
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#define RECORD_MAGIC "BRGREC3\n"
+
+typedef struct {
+	/* Microseconds since the previous entry. 64 bits, as 32 wrap after a
+	 * little over an hour of idling. */
+	uint64_t dt;
+	/* X event type. */
+	uint8_t type;
+	/* Button or keycode. */
+	uint8_t detail;
+	/* Modifiers for input, value_mask for ConfigureRequest. */
+	uint16_t state;
+	/* The client window as seen when recording, 0 for the root. */
+	uint32_t window;
+	/* Server time of input events. */
+	uint32_t time;
+	/* Pointer root position for input, geometry for MapRequest and
+	 * ConfigureRequest. */
+	int16_t x;
+	int16_t y;
+	uint16_t w;
+	uint16_t h;
+	uint16_t len;
+	uint16_t pad;
+	/* data.l of client messages. Atoms are only told apart from None here,
+	 * their names are in the text. */
+	int32_t data[4];
+} RecordEntry;
+
+#endif /* __RECORD_INCLUDED */